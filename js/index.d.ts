@@ -29,6 +29,15 @@ export enum GameState {
   /** Indicates the game has ended in a draw */
   GAME_STALEMATE = 1,
 }
+/** The kind of score held by a transposition table entry */
+export enum Bound {
+  /** The score is exact */
+  EXACT = 1,
+  /** The real score is at least this, the search failed high */
+  LOWER = 2,
+  /** The real score is at most this, the search failed low */
+  UPPER = 3,
+}
 /**
  * A BitBoard is a way of representing the spaces of the chess board. Each bit corresponds to
 a square on the board, and is on or off depending on what data that BitBoard represents.
@@ -58,6 +67,154 @@ export type Move = {
   castle: boolean;
 };
 
+/** AttackInfo describes the checks and pins against the player to move */
+export type AttackInfo = {
+  /** The opposing pieces giving check */
+  checkers: BitBoard;
+  /** Squares a non-king move must land on: every square if not in check, none in double check */
+  checkMask: BitBoard;
+  /** The player's pieces pinned to their king */
+  pinned: BitBoard;
+  /** Squares pinned pieces may move along, per line: N-S, NE-SW, E-W, SE-NW. Includes the pinners */
+  pinRays: [BitBoard, BitBoard, BitBoard, BitBoard];
+  /** Squares attacked by the opponent, looking through the player's king */
+  attacked: BitBoard;
+};
+
+/** BoardPoolStats gives a snapshot of the native Board allocator */
+export type BoardPoolStats = {
+  /** Boards currently allocated and not yet freed */
+  live: number;
+  /** The most boards ever live at once */
+  peak: number;
+  /** Board slots the pool has reserved from the system, used or not */
+  pooled: number;
+};
+
+/** SearchLimits tells {@linkcode search()} when to stop and how to score positions. Unset limits don't apply */
+export type SearchLimits = {
+  /** The deepest iteration to search */
+  depth?: number;
+  /** Stop after about this many nodes */
+  nodes?: number;
+  /** Stop after about this many milliseconds */
+  timeMs?: number;
+  /** A table to keep results in between searches. With more than one thread, a 16MB table is made for the search if this isn't given */
+  tt?: TranspositionTable;
+  /** Threads to search with, defaults to the number set by {@linkcode setSearchThreads()} */
+  threads?: number;
+  /** Material values in centipawns for the built in evaluation. Unset pieces keep the defaults of 100, 330, 320, 500 and 900 */
+  pieceValues?: {
+    pawn?: number;
+    bishop?: number;
+    knight?: number;
+    rook?: number;
+    queen?: number;
+  };
+};
+
+/**
+ * A native transposition table, caching search results by zobrist key without a JS Map of bigints.
+ *
+ * Moves are stored packed, see {@linkcode packMove()}. The table is lock free, so searches on other threads may share it.
+ */
+export interface TranspositionTable {
+  /**
+   * Looks up a position.
+   *
+   * If found, writes the packed move (0 if none), score, depth and {@linkcode Bound} to `out[0]` to `out[3]`.
+   * Reuse one `out` array to avoid allocating per probe.
+   * @param key The zobrist key of the position, see {@linkcode Board.zobristKey()}
+   * @param out Receives the entry
+   * @returns Whether the position was found
+   */
+  probe(key: bigint, out: Int32Array): boolean;
+  /**
+   * Stores a search result, replacing the entry for the same key or the least useful entry near it.
+   * @param key The zobrist key of the position
+   * @param move The best move found, packed, or 0 to keep the move already stored
+   * @param score The score for the player to move, which must fit in 16 bits
+   * @param depth The depth searched, 0-255
+   * @param bound Whether the score is exact or a bound
+   */
+  store(key: bigint, move: number, score: number, depth: number, bound: Bound): void;
+  /**
+   * Hints the CPU to start loading the entries for a key which will be probed shortly.
+   * @param key The zobrist key of the position
+   */
+  prefetch(key: bigint): void;
+  /** Removes every entry. Must not be called while a {@linkcode search()} is using the table */
+  clear(): void;
+  /** Marks the start of a new search, so entries stored before are replaced first. {@linkcode search()} does this itself */
+  newSearch(): void;
+  /** Returns how full the table is with entries from the current search, in parts per thousand */
+  hashfull(): number;
+}
+
+/** SearchResult is the outcome of {@linkcode search()} */
+export type SearchResult = {
+  /** The best move found, or `null` if there are no legal moves */
+  move: Move | null;
+  /** The score of the best move in centipawns for the player to move. Mates score 32000 less the number of plies to mate */
+  score: number;
+  /** The last iteration that finished */
+  depth: number;
+  /** The number of positions visited */
+  nodes: number;
+  /** The expected line of play, starting with `move` */
+  pv: Move[];
+};
+
+/**
+ * Hands out the legal moves of a position in stages: the hash move, captures and promotions by most valuable victim and
+ * least valuable attacker, the killer moves, then the quiet moves. Each stage is only generated once the previous one is used up.
+ *
+ * Hash and killer moves which aren't legal in the position are left out, and no move is handed out twice.
+ */
+export interface MovePicker {
+  /**
+   * @returns The next move, or `null` once every legal move was handed out
+   */
+  next(): Move | null;
+}
+
+/**
+ * Killer moves and history scores gathered by a search, for ordering moves natively without a call per move.
+ *
+ * Moves are passed packed, see {@linkcode packMove()} and {@linkcode Board.getLegalMovesPacked()}.
+ */
+export interface MoveOrdering {
+  /**
+   * Scores moves for searching them in order, higher first.
+   *
+   * Captures and queen promotions score 65536 or more, by most valuable victim then least valuable attacker.
+   * The killer moves of the ply score 32769 and 32768, other quiet moves their history score below 16384.
+   * Underpromotions score 1024 less than they otherwise would.
+   * @param board The board the moves are played on
+   * @param moves The packed moves, at most 256
+   * @param scores Receives a score for each move
+   * @param ply The number of moves from the root of the search, for the killer moves
+   */
+  scoreMoves(board: Board, moves: Uint32Array, scores: Int32Array, ply: number): void;
+  /**
+   * Scores moves like {@linkcode MoveOrdering.scoreMoves()} and sorts them in place, best first
+   * @param board The board the moves are played on
+   * @param moves The packed moves, at most 256
+   * @param ply The number of moves from the root of the search, for the killer moves
+   */
+  orderMoves(board: Board, moves: Uint32Array, ply: number): void;
+  /**
+   * Records that a move caused a beta cutoff. Quiet moves become the first killer of their ply and gain history by depth squared
+   * @param board The board the move was played on, as it was before the move
+   * @param move The packed move
+   * @param ply The number of moves from the root of the search, 0-63
+   * @param depth The remaining depth the move was searched at
+   */
+  update(board: Board, move: number, ply: number, depth: number): void;
+  /** Forgets every killer move and history score */
+  clear(): void;
+}
+
 export interface Board {
   /**
    * @returns A clone of this board
@@ -67,6 +224,54 @@ export interface Board {
    * @returns An array of legal moves on this board
    */
   getLegalMoves(): Move[];
+  /**
+   * Same as {@linkcode Board.getLegalMoves()}, but as packed moves, see {@linkcode packMove()}, without making an object per move
+   * @returns A typed array of packed legal moves on this board
+   */
+  getLegalMovesPacked(): Uint32Array;
+  /**
+   * Quiet moves aren't generated at all, which makes this cheaper than filtering {@linkcode Board.getLegalMoves()}
+   * @returns An array of the legal captures and promotions on this board, en passant included
+   */
+  getLegalCaptures(): Move[];
+  /**
+   * Together with {@linkcode Board.getLegalCaptures()} this gives every legal move exactly once
+   * @returns An array of the legal moves on this board which neither capture nor promote, castling included
+   */
+  getLegalQuiets(): Move[];
+  /**
+   * Creates a {@linkcode MovePicker} handing out the legal moves of this board in stages
+   *
+   * The picker works on a copy of the board, so later changes to this board don't affect it.
+   * @param hashMove A move to try first, usually from a {@linkcode TranspositionTable}
+   * @param killers Up to two quiet moves to try right after the captures
+   */
+  createMovePicker(hashMove?: Move | null, killers?: (Move | null)[]): MovePicker;
+  /**
+   * Checks a move against the check and pin information of this board, without generating the legal moves.
+   *
+   * The `capture`, `castle` and `promotion` fields must be as {@linkcode Board.getLegalMoves()} would give them.
+   * Safe to call with any move, such as one from a {@linkcode TranspositionTable} entry of another position, see {@linkcode unpackMove()}
+   * @param move The move to check, for the player to move
+   * @returns `true` if the move is legal
+   */
+  isLegalMove(move: Move): boolean;
+  /**
+   * Like {@linkcode Board.isLegalMove()}, but accepts moves which leave or put the king in check. Castling still needs its squares safe
+   * @param move The move to check, for the player to move
+   * @returns `true` if the move follows the way its piece moves
+   */
+  isPseudoLegalMove(move: Move): boolean;
+  /**
+   * Stops at the first legal move found, so this is much cheaper than checking {@linkcode Board.getLegalMoves()} for an empty array
+   * @returns `true` if the current player has at least one legal move
+   */
+  hasLegalMoves(): boolean;
+  /**
+   * Counts the legal moves without building the array
+   * @returns The number of legal moves on this board
+   */
+  countLegalMoves(): number;
   /**
    * See also: {@linkcode Board.isBlackTurn()}
    * @returns `true` if it is white to move
@@ -93,11 +298,23 @@ export interface Board {
    * @returns `true` if the current player is in checkmate
    */
   inCheckmate(): boolean;
+  /**
+   * The result is cached on the board until the next move, so repeated calls are cheap.
+   * @returns The checks and pins against the current player
+   */
+  getAttackInfo(): AttackInfo;
   /**
    * This function considers positions with no legal moves, the 50-move rule, and threefold repetition as draws.
    * @returns `true` if the current player is in a draw for any reason
    */
   inDraw(): boolean;
+  /**
+   * Returns whether a search should score this position as a repetition draw: it occurred before within the last `ply` moves,
+   * since the side repeating could do it again, or twice before that. Only moves since the last capture or pawn move are looked at.
+   * @param ply The number of moves since the root of the search. With 0, the default, this is the threefold repetition rule
+   * @returns `true` if the position is a repetition
+   */
+  isRepetition(ply?: number): boolean;
   /**
    * You lose kingside castling rights if you move your king or the kingside rook
    *
@@ -130,6 +347,27 @@ export interface Board {
    * The hashes consider en passant and castling possibilities as part of the hash, these will create different hashes for otherwise visually identical positions
    */
   zobristKey(): bigint;
+  /**
+   * Returns the static exchange evaluation of a move: the material won or lost in centipawns if both sides
+   * keep capturing on its target square with their least valuable piece, stopping when that's better for them.
+   *
+   * Pieces are worth 100, 320, 330, 500 and 900 for pawn, knight, bishop, rook and queen. Pins and checks aren't considered.
+   * @param move The move to evaluate, from the player to move
+   */
+  see(move: Move): number;
+  /**
+   * Returns whether the static exchange evaluation of a move is at least `threshold`, see {@linkcode Board.see()}
+   *
+   * Cheaper than comparing `see()` when the captured and capturing pieces alone decide it.
+   * @param move The move to evaluate, from the player to move
+   * @param threshold The least material to win, in centipawns
+   */
+  seeGe(move: Move, threshold: number): boolean;
+  /**
+   * Returns the static exchange evaluation of each of `moves`, see {@linkcode Board.see()}
+   * @param moves The moves to evaluate, from the player to move
+   */
+  seeMoves(moves: Move[]): Int32Array;
   /**
    * Performs a move on the board
    *
@@ -241,8 +479,30 @@ export function getTimeMillis(): number;
 export function getOpponentTimeMillis(): number;
 /**
  * Returns how much time has elapsed this turn, in ms.
+ *
+ * Measured in wall time from when the GUI said go, so search threads and time spent blocked are counted correctly.
+ *
+ * See also: {@linkcode getElapsedTimeMicros()}
  */
 export function getElapsedTimeMillis(): number;
+/**
+ * Returns how much time has elapsed this turn, in microseconds.
+ */
+export function getElapsedTimeMicros(): number;
+/**
+ * Returns the time at which a time budget for this turn runs out.
+ *
+ * Compute it once per turn and compare {@linkcode getMonotonicMicros()} against it, which is cheaper than asking for the elapsed time.
+ * @param budgetMillis How long the turn may take, counted from when the GUI said go, in ms
+ * @returns The deadline, in {@linkcode getMonotonicMicros()} time
+ */
+export function getTurnDeadlineMicros(budgetMillis: number): number;
+/**
+ * Returns the current time of a monotonic clock, in microseconds.
+ *
+ * The clock is not changed by adjustments to the system time. Only the difference between two readings is meaningful.
+ */
+export function getMonotonicMicros(): number;
 /**
  * Returns a square index equivalent to the square indicated by the given bitboard.
  *
@@ -267,3 +527,130 @@ export function getBitboardFromIndex(index: number): BitBoard;
  * @returns The move made by the opponent on the last play.
  */
 export function getOpponentMove(): Move;
+/**
+ * Returns the number of set squares on the given bitboard.
+ * @param bitboard The bitboard to count.
+ * @returns A count from 0-64.
+ */
+export function popcount(bitboard: BitBoard): number;
+/**
+ * Returns the square index of every set square on the given bitboard, lowest first.
+ *
+ * See also: {@linkcode getIndexFromBitboard()}
+ * @param bitboard The bitboard to list the squares of.
+ * @returns An array of indices from 0-63.
+ */
+export function getIndicesFromBitboard(bitboard: BitBoard): number[];
+/**
+ * Returns statistics on native Board allocation.
+ *
+ * Boards are only freed once garbage collected, so `live` may stay above the number of boards you still hold for a while.
+ * @returns The live, peak and pooled board counts
+ */
+export function getBoardPoolStats(): BoardPoolStats;
+/**
+ * Prepares the module for use without a UCI server, e.g. to analyse games or run perft from a script.
+ *
+ * Boards from {@linkcode boardFromFen()} can be played, undone, searched and checked for game end without the UCI server ever starting.
+ * It is still started by the first call to {@linkcode getBoard()}, {@linkcode done()} or the other match functions.
+ * Calling this is optional, and more than once is harmless.
+ */
+export function initHeadless(): void;
+/**
+ * Returns which CPU-specific implementation the native move generator is using, for diagnostics.
+ *
+ * Set the `CHESS_BACKEND` environment variable before loading the module to limit the features used, e.g. `"avx2"` or `"scalar"`.
+ * @returns One of `"scalar"`, `"bmi2"`, `"avx2"` or `"bmi2+avx2"`
+ */
+export function getBackend(): "scalar" | "bmi2" | "avx2" | "bmi2+avx2";
+/**
+ * Creates a board from a position in Forsyth-Edwards Notation.
+ *
+ * The board has no move history, so {@linkcode Board.undoMove()} does nothing until moves are made on it.
+ *
+ * Invalid FENs throw rather than producing a corrupt board: unknown characters, ranks that aren't 8 squares,
+ * anything but one king per side, pawns on the first or last rank and malformed side, castling, en passant or move count fields.
+ * @param fen The position, e.g. `"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"`
+ * @returns A new board
+ * @throws TypeError with code `BADCHESS` if the FEN is invalid
+ */
+export function boardFromFen(fen: string): Board;
+/**
+ * Returns the Zobrist hash of a position without creating a board.
+ *
+ * Keys come from a fixed seed, so a position hashes to the same value in every process and can be stored, e.g. in an opening book.
+ * @param fen The position in Forsyth-Edwards Notation
+ * @returns The same hash {@linkcode Board.zobristKey()} gives for a board created from the FEN
+ * @throws TypeError with code `BADCHESS` if the FEN is invalid, see {@linkcode boardFromFen()}
+ */
+export function zobristKeyFromFen(fen: string): bigint;
+/**
+ * Counts the positions reachable from the board in exactly `depth` moves, on a background thread.
+ *
+ * This is the standard perft test, useful for checking and benchmarking move generation.
+ * The board is copied first, so it may be used as normal while the promise is pending.
+ *
+ * See also: {@link setPerftThreads()}
+ * @param board The board to start from
+ * @param depth The number of moves to play out
+ * @returns A promise of the number of leaf positions
+ */
+export function perft(board: Board, depth: number): Promise<number>;
+/**
+ * Runs {@link perft()} below each legal move on the board, on a background thread.
+ *
+ * Comparing against another engine's divide output narrows down a perft mismatch.
+ * @param board The board to start from
+ * @param depth The number of moves to play out, including the root move
+ * @returns A promise of the count for each legal move, keyed by the move in algebraic notation such as `"e2e4"`
+ */
+export function perftDivide(board: Board, depth: number): Promise<Record<string, number>>;
+/**
+ * Sets how many threads {@link perft()} and {@link perftDivide()} split the root moves over.
+ *
+ * Defaults to 1. Values are clamped to 1-64.
+ * @param threads The number of threads to use
+ */
+export function setPerftThreads(threads: number): void;
+/**
+ * Searches for the best move on the board natively, on a background thread.
+ *
+ * A principal variation search by iterative deepening, with aspiration windows, null move pruning and a quiescence search.
+ * The search stops at whichever limit comes first. If none are given it stops after depth 6.
+ * With more than one thread, helper threads search alongside and share their results through the transposition table (Lazy SMP).
+ * The board is cloned first, so it may be used as normal while the promise is pending.
+ * @param board The position to search
+ * @param limits When to stop and how to score positions
+ * @returns A promise of the best move and line found by the last finished iteration
+ */
+export function search(board: Board, limits?: SearchLimits): Promise<SearchResult>;
+/**
+ * Sets how many threads {@link search()} uses when its limits don't say.
+ *
+ * Defaults to 1. Values are clamped to 1-64. The UCI option `Threads` sets this too.
+ * @param threads The number of threads to use
+ */
+export function setSearchThreads(threads: number): void;
+/**
+ * Creates an empty transposition table.
+ * @param sizeMb The most memory to use, in megabytes. Rounded down to a power of two number of 64 byte buckets
+ * @returns The new table, freed when garbage collected
+ */
+export function createTranspositionTable(sizeMb: number): TranspositionTable;
+/**
+ * Packs a move into a 17 bit number, keeping every field, for storing in a {@linkcode TranspositionTable} or a typed array.
+ * @param move The move to pack
+ * @returns The packed move
+ */
+export function packMove(move: Move): number;
+/**
+ * Unpacks a move packed by {@linkcode packMove()}.
+ * @param packed The packed move
+ * @returns The move, or `null` for 0
+ */
+export function unpackMove(packed: number): Move | null;
+/**
+ * Creates an empty {@linkcode MoveOrdering}. Use one per search.
+ * @returns The new MoveOrdering, freed when garbage collected
+ */
+export function createMoveOrdering(): MoveOrdering;
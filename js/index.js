@@ -15,5 +15,10 @@ module.exports = Object.assign(require("bindings")("chessapi-node.node"), {
         GAME_CHECKMATE: -1,
         GAME_NORMAL: 0,
         GAME_STALEMATE: 1,
+    },
+    Bound: {
+        EXACT: 1,
+        LOWER: 2,
+        UPPER: 3,
     }
 });
\ No newline at end of file
@@ -1,30 +1,69 @@
 #include "bitboard.h"
+#include <threads.h>
+#include <stdlib.h>
+#include <string.h>
 
-#define _bb_flood(dir) BitBoard bb_flood_ ## dir (BitBoard board, BitBoard empty, bool captures) { \
+// the AVX2 and BMI2 kernels are built with per-function target attributes, so the rest of the library
+// still runs on any x86-64. they're only used if the CPU reports support, see select_backend().
+// MSVC compiles the intrinsics without any target flags, so it needs no attribute
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define BB_X64
+#define BB_TARGET(feature) __attribute__((target(feature)))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define BB_X64
+#define BB_TARGET(feature)
+#endif
+#if defined(BB_X64) && !defined(CHESS_NO_AVX2)
+#define BB_AVX2_KERNEL
+#endif
+#if defined(BB_X64) && !defined(CHESS_NO_BMI2)
+#define BB_BMI2_KERNEL
+#endif
+#if defined(BB_AVX2_KERNEL) || defined(BB_BMI2_KERNEL)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+typedef BitBoard (*SliderFloodKernel)(BitBoard orth, BitBoard diag, BitBoard empty, bool captures);
+typedef BitBoard (*SliderLookup)(int square, BitBoard occupied);
+
+// The implementations picked for this CPU. Starts out on the portable ones, which work before bb_init() too.
+typedef struct
+{
+    const char *name;
+    SliderFloodKernel slider_flood;
+    SliderLookup rook_attacks;
+    SliderLookup bishop_attacks;
+} Backend;
+
+static BitBoard slider_flood_scalar(BitBoard orth, BitBoard diag, BitBoard empty, bool captures);
+static BitBoard rook_attacks_magic(int square, BitBoard occupied);
+static BitBoard bishop_attacks_magic(int square, BitBoard occupied);
+static Backend backend = {"scalar", &slider_flood_scalar, &rook_attacks_magic, &bishop_attacks_magic};
+
+// Floods are Kogge-Stone parallel prefix fills: rather than stepping one square at a time, the
+// fill and the set of squares it may travel through are each shifted by 1, 2 then 4 squares,
+// covering any run of up to 7 squares in three branch-free steps. [mask] keeps shifts from
+// wrapping around the board edge, and [far] moves a square 7 steps, used for the blocker edge case.
+#define _bb_flood(dir, op, step, mask) BitBoard bb_flood_ ## dir (BitBoard board, BitBoard empty, bool captures) { \
     BitBoard gen = board; \
-    for (int i = 0; i < 7; i++) { \
-        gen |= bb_slide_ ## dir (gen) & empty; \
-    } \
+    BitBoard pro = empty & (mask); \
+    gen |= pro & (gen op (step)); \
+    pro &= pro op (step); \
+    gen |= pro & (gen op (2 * (step))); \
+    pro &= pro op (2 * (step)); \
+    gen |= pro & (gen op (4 * (step))); \
     return captures ? bb_slide_ ## dir (gen) : gen & empty; \
 }
 
-#define _bb_blocker(dir) BitBoard bb_blocker_ ## dir (BitBoard board, BitBoard empty) { \
-    BitBoard gen = board; \
-    for (int i = 0; i < 7; i++) { \
-        gen = bb_slide_ ## dir (gen); \
-        if ((gen & empty) == 0) return gen; \
-    } \
-    return gen; \
-}
-
-#define _all_dirs(submacro) submacro(n) \
-    submacro(ne) \
-    submacro(e) \
-    submacro(se) \
-    submacro(s) \
-    submacro(sw) \
-    submacro(w) \
-    submacro(nw) \
+// A blocker is the first occluded square of the fill. If the ray runs a full 7 squares without
+// finding one, the last square is returned regardless, as the stepping version always did.
+#define _bb_blocker(dir, far) BitBoard bb_blocker_ ## dir (BitBoard board, BitBoard empty) { \
+    BitBoard ray = bb_flood_ ## dir (board, empty, true); \
+    return ray & (~empty | (far)); \
+}
 
 // Debug print function
 // [buffer] should be at least 72 bytes
@@ -83,9 +122,348 @@ BitBoard bb_slide_sw(BitBoard board) {
 // marking spaces until encountering an occluded space according to [empty], then return all
 // marked spaces. If [captures], then includes the occluded space.
 
-_all_dirs(_bb_flood)
+_bb_flood(n, <<, 8, ~0ull)
+_bb_flood(ne, <<, 9, 0xfefefefefefefefeull)
+_bb_flood(e, <<, 1, 0xfefefefefefefefeull)
+_bb_flood(se, >>, 7, 0xfefefefefefefefeull)
+_bb_flood(s, >>, 8, ~0ull)
+_bb_flood(sw, >>, 9, 0x7f7f7f7f7f7f7f7full)
+_bb_flood(w, >>, 1, 0x7f7f7f7f7f7f7f7full)
+_bb_flood(nw, <<, 7, 0x7f7f7f7f7f7f7f7full)
+
+// Multi-direction floods run one kernel over all eight directions: [orth] is flooded north, east,
+// south and west, [diag] is flooded along the four diagonals, and the results are combined.
+
+static BitBoard slider_flood_scalar(BitBoard orth, BitBoard diag, BitBoard empty, bool captures) {
+    return bb_flood_n(orth, empty, captures) | bb_flood_e(orth, empty, captures) | bb_flood_s(orth, empty, captures) | bb_flood_w(orth, empty, captures) |
+           bb_flood_ne(diag, empty, captures) | bb_flood_se(diag, empty, captures) | bb_flood_sw(diag, empty, captures) | bb_flood_nw(diag, empty, captures);
+}
+
+#ifdef BB_AVX2_KERNEL
+// Shifts each lane of [x] left by its count in [left] and right by its count in [right]. Each lane
+// only goes one way, the other count being 64 or more, which shifts every bit out.
+BB_TARGET("avx2") static inline __m256i shift4(__m256i x, __m256i left, __m256i right) {
+    return _mm256_or_si256(_mm256_sllv_epi64(x, left), _mm256_srlv_epi64(x, right));
+}
+
+// The Kogge-Stone flood from _bb_flood, four directions at a time, one per 64-bit lane.
+BB_TARGET("avx2") static inline __m256i flood4(__m256i gen, __m256i empty, __m256i left, __m256i right, __m256i mask, bool captures) {
+    __m256i pro = _mm256_and_si256(empty, mask);
+    gen = _mm256_or_si256(gen, _mm256_and_si256(pro, shift4(gen, left, right)));
+    pro = _mm256_and_si256(pro, shift4(pro, left, right));
+    __m256i left2 = _mm256_slli_epi64(left, 1);
+    __m256i right2 = _mm256_slli_epi64(right, 1);
+    gen = _mm256_or_si256(gen, _mm256_and_si256(pro, shift4(gen, left2, right2)));
+    pro = _mm256_and_si256(pro, shift4(pro, left2, right2));
+    gen = _mm256_or_si256(gen, _mm256_and_si256(pro, shift4(gen, _mm256_slli_epi64(left, 2), _mm256_slli_epi64(right, 2))));
+    // the edge masks double as the slide masks, so this is bb_slide_* for each lane
+    return captures ? _mm256_and_si256(shift4(gen, left, right), mask) : _mm256_and_si256(gen, empty);
+}
+
+BB_TARGET("avx2") static BitBoard slider_flood_avx2(BitBoard orth, BitBoard diag, BitBoard empty, bool captures) {
+    // lanes are n, e, s, w for [orth] and ne, se, sw, nw for [diag]
+    const __m256i orth_left = _mm256_setr_epi64x(8, 1, 64, 64);
+    const __m256i orth_right = _mm256_setr_epi64x(64, 64, 8, 1);
+    const __m256i orth_mask = _mm256_setr_epi64x(-1ll, (long long)0xfefefefefefefefeull, -1ll, (long long)0x7f7f7f7f7f7f7f7full);
+    const __m256i diag_left = _mm256_setr_epi64x(9, 64, 64, 7);
+    const __m256i diag_right = _mm256_setr_epi64x(64, 7, 9, 64);
+    const __m256i diag_mask = _mm256_setr_epi64x((long long)0xfefefefefefefefeull, (long long)0xfefefefefefefefeull, (long long)0x7f7f7f7f7f7f7f7full, (long long)0x7f7f7f7f7f7f7f7full);
+    __m256i empty4 = _mm256_set1_epi64x((long long)empty);
+    __m256i fill = _mm256_or_si256(flood4(_mm256_set1_epi64x((long long)orth), empty4, orth_left, orth_right, orth_mask, captures),
+                                   flood4(_mm256_set1_epi64x((long long)diag), empty4, diag_left, diag_right, diag_mask, captures));
+    __m128i half = _mm_or_si128(_mm256_castsi256_si128(fill), _mm256_extracti128_si256(fill, 1));
+    return (BitBoard)(_mm_cvtsi128_si64(half) | _mm_extract_epi64(half, 1));
+}
+#endif
+
+BitBoard bb_flood_orthogonal(BitBoard board, BitBoard empty, bool captures) {
+    return backend.slider_flood(board, 0, empty, captures);
+}
+
+BitBoard bb_flood_diagonal(BitBoard board, BitBoard empty, bool captures) {
+    return backend.slider_flood(0, board, empty, captures);
+}
+
+BitBoard bb_flood_all(BitBoard board, BitBoard empty, bool captures) {
+    return backend.slider_flood(board, board, empty, captures);
+}
+
+BitBoard bb_slider_attacks(BitBoard orth, BitBoard diag, BitBoard empty) {
+    return backend.slider_flood(orth, diag, empty, true);
+}
 
 // Directional BitBoard blocker functions travel from position [board] in the given direction
 // until encountering an occluded space according to [empty], then returns this occluded space.
 
-_all_dirs(_bb_blocker)
\ No newline at end of file
+_bb_blocker(n, board << 56)
+_bb_blocker(ne, (board & 0x0000000000000001ull) << 63)
+_bb_blocker(e, (board & 0x0101010101010101ull) << 7)
+_bb_blocker(se, (board & 0x0100000000000000ull) >> 49)
+_bb_blocker(s, board >> 56)
+_bb_blocker(sw, (board & 0x8000000000000000ull) >> 63)
+_bb_blocker(w, (board & 0x8080808080808080ull) >> 7)
+_bb_blocker(nw, (board & 0x0000000000000080ull) << 49)
+
+// Sliding piece attack lookups, backed by "fancy" magic bitboards. Each square has a mask of
+// the squares whose occupancy can affect its attacks; multiplying the masked occupancy by the
+// square's magic number maps every relevant occupancy to a unique slot in the attack table.
+// On CPUs with fast BMI2, PEXT packs the masked occupancy into an index directly instead.
+
+typedef struct
+{
+    BitBoard mask;
+    BitBoard magic;
+    BitBoard *attacks;
+    BitBoard *pext_attacks;
+    int shift;
+} Magic;
+
+static const BitBoard rook_magic_numbers[64] = {
+    0x1080004008801020ull, 0x0840092002c03000ull, 0x1900200010400900ull, 0x0880100008000480ull,
+    0x4200100420080200ull, 0x8100020100080400ull, 0x0200040110886200ull, 0x0200008040220411ull,
+    0x0404800084400220ull, 0x0000401000402000ull, 0x0086001081220440ull, 0x0408800800100280ull,
+    0x000a001201040820ull, 0x8848800200840080ull, 0x4001000100040200ull, 0x0442000102105084ull,
+    0x9080010020804100ull, 0x0040404000201009ull, 0x0000808010002009ull, 0x2200090021d00100ull,
+    0x0008008008040080ull, 0x0004004002010040ull, 0x0011040008015042ull, 0x00000a0001768104ull,
+    0x0000800080204009ull, 0x2010004140002001ull, 0x9800200280100080ull, 0x1000100080080080ull,
+    0x0442000a00049020ull, 0x2100040080020080ull, 0x0800120400900148ull, 0x0010040a00128541ull,
+    0x2800804000800030ull, 0x1010002000400041ull, 0x4000200011004100ull, 0x0610008410800800ull,
+    0x0400802402800800ull, 0xc100020080800400ull, 0x0002000802000401ull, 0x0182085882000401ull,
+    0x0220204000808000ull, 0x2860100040024022ull, 0x0001002004110040ull, 0x99101042000a0020ull,
+    0x0004080004008080ull, 0x0010040002008080ull, 0x2012004881020004ull, 0x8300842444820011ull,
+    0x0088403882010200ull, 0x0820400080210100ull, 0x0110910040a00300ull, 0x0801100280080480ull,
+    0x0242009008200600ull, 0x1002000489500200ull, 0x0040800200010080ull, 0x0091800041000080ull,
+    0x0000209300488001ull, 0x04c1002414824001ull, 0x020020000b001041ull, 0x7000100004200901ull,
+    0x8002002004100802ull, 0x30010002084c0007ull, 0x0888221800813004ull, 0x4000002840840112ull,
+};
+
+static const BitBoard bishop_magic_numbers[64] = {
+    0xa010041108003100ull, 0x006082020a002900ull, 0x6810010619200000ull, 0x08281a0520000408ull,
+    0x0001104001000400ull, 0x0018901008048400ull, 0x00040a0210245280ull, 0x000200210808a402ull,
+    0x9140048410821200ull, 0x0800091010820041ull, 0x20504804832202c0ull, 0x0100091401081000ull,
+    0x8021011140000012ull, 0x0810020804450400ull, 0x208b0542109008a2ull, 0x0080084a08040204ull,
+    0x0040e2a80811244cull, 0x2505022008008108ull, 0x0430220100420040ull, 0x010a040420220040ull,
+    0x1105000290400000ull, 0x0093001200822120ull, 0x4000a62048043004ull, 0x280120048a015004ull,
+    0x006090002a020814ull, 0x44042000240800d0ull, 0x01102800040a4400ull, 0x1004080080220040ull,
+    0x0001001011004024ull, 0x0010044000805040ull, 0x0914041200820100ull, 0x0004821012821480ull,
+    0x0024040500c05021ull, 0x0088611002080200ull, 0x0116080a00040020ull, 0x4000020080080080ull,
+    0x2450450140840040ull, 0x0000880201484100ull, 0x0222020404020092ull, 0x8081110600002e00ull,
+    0x2842101105000801ull, 0x1100809008001025ull, 0x00020202221c0400ull, 0x0422014022009020ull,
+    0x0210046102100c00ull, 0xc004008082029102ull, 0x00aa461801101200ull, 0x0404080080201108ull,
+    0x020542108c205002ull, 0x0410544804100100ull, 0x0040910841100000ull, 0x0400200042021100ull,
+    0x00004204850400c0ull, 0x0200100410a42102ull, 0x1040020801210102ull, 0x0805040410420000ull,
+    0x2884804130100200ull, 0x800c262201242000ull, 0x1058000194108800ull, 0x0014221054420204ull,
+    0x0104000012a02200ull, 0x0200881003300100ull, 0x0140400202840100ull, 0x0402020801010201ull,
+};
+
+static Magic rook_magics[64];
+static Magic bishop_magics[64];
+static BitBoard rook_table[102400];
+static BitBoard bishop_table[5248];
+#ifdef BB_BMI2_KERNEL
+// PEXT indexed tables have the same layout, but in the order the occupancies are enumerated below
+static BitBoard rook_pext_table[102400];
+static BitBoard bishop_pext_table[5248];
+#endif
+static once_flag magics_once = ONCE_FLAG_INIT;
+
+static BitBoard rook_flood(BitBoard board, BitBoard empty)
+{
+    return bb_flood_orthogonal(board, empty, true);
+}
+
+static BitBoard bishop_flood(BitBoard board, BitBoard empty)
+{
+    return bb_flood_diagonal(board, empty, true);
+}
+
+// Fills the attack table for each square by walking every subset of its occupancy mask.
+static void init_magics(Magic *magics, const BitBoard *magic_numbers, BitBoard *table, BitBoard *pext_table, BitBoard (*flood)(BitBoard, BitBoard))
+{
+    const BitBoard edges_ns = 0xff000000000000ffull;
+    const BitBoard edges_ew = 0x8181818181818181ull;
+    for (int square = 0; square < 64; square++)
+    {
+        BitBoard board = ((BitBoard)1) << square;
+        // edge squares never block anything beyond them, unless the piece is on that edge itself
+        BitBoard edges = (edges_ns & ~(0xffull << (square & 56))) | (edges_ew & ~(0x0101010101010101ull << (square & 7)));
+        Magic *m = &magics[square];
+        m->mask = flood(board, ~0ull) & ~edges;
+        m->magic = magic_numbers[square];
+        m->shift = 64 - bb_popcount(m->mask);
+        m->attacks = table;
+        m->pext_attacks = pext_table;
+        // enumerate all subsets of the mask (Carry-Rippler). this counts up through the mask bits, so the
+        // n-th subset is the one PEXT maps to n
+        BitBoard occupied = 0;
+        size_t index = 0;
+        do
+        {
+            BitBoard attacks = flood(board, ~occupied);
+            m->attacks[(occupied * m->magic) >> m->shift] = attacks;
+            if (pext_table != NULL)
+                m->pext_attacks[index++] = attacks;
+            occupied = (occupied - m->mask) & m->mask;
+        } while (occupied);
+        table += ((BitBoard)1) << (64 - m->shift);
+        if (pext_table != NULL)
+            pext_table += ((BitBoard)1) << (64 - m->shift);
+    }
+}
+
+static BitBoard rook_attacks_magic(int square, BitBoard occupied)
+{
+    const Magic *m = &rook_magics[square];
+    return m->attacks[((occupied & m->mask) * m->magic) >> m->shift];
+}
+
+static BitBoard bishop_attacks_magic(int square, BitBoard occupied)
+{
+    const Magic *m = &bishop_magics[square];
+    return m->attacks[((occupied & m->mask) * m->magic) >> m->shift];
+}
+
+#ifdef BB_BMI2_KERNEL
+BB_TARGET("bmi2") static BitBoard rook_attacks_pext(int square, BitBoard occupied)
+{
+    const Magic *m = &rook_magics[square];
+    return m->pext_attacks[_pext_u64(occupied, m->mask)];
+}
+
+BB_TARGET("bmi2") static BitBoard bishop_attacks_pext(int square, BitBoard occupied)
+{
+    const Magic *m = &bishop_magics[square];
+    return m->pext_attacks[_pext_u64(occupied, m->mask)];
+}
+#endif
+
+// Returns true if [feature] may be used according to the CHESS_BACKEND environment variable.
+// Unset allows everything; otherwise it lists the features to allow, e.g. "bmi2", "avx2" or "scalar" for none.
+static bool backend_allows(const char *feature)
+{
+    const char *allowed = getenv("CHESS_BACKEND");
+    return allowed == NULL || *allowed == '\0' || strstr(allowed, feature) != NULL;
+}
+
+#if (defined(BB_AVX2_KERNEL) || defined(BB_BMI2_KERNEL)) && defined(_MSC_VER)
+// MSVC has no __builtin_cpu_supports, so these ask CPUID directly. [regs] gets eax, ebx, ecx and edx
+static void cpuid(int leaf, int regs[4])
+{
+    __cpuidex(regs, leaf, 0);
+}
+
+static bool cpu_supports_avx2()
+{
+    int regs[4];
+    cpuid(0, regs);
+    if (regs[0] < 7)
+        return false;
+    cpuid(1, regs);
+    // the OS must save the YMM registers on a context switch too: OSXSAVE, AVX, then XCR0 bits 1 and 2
+    if ((regs[2] & (1 << 27)) == 0 || (regs[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+        return false;
+    cpuid(7, regs);
+    return (regs[1] & (1 << 5)) != 0;
+}
+
+static bool cpu_supports_bmi2()
+{
+    int regs[4];
+    cpuid(0, regs);
+    if (regs[0] < 7)
+        return false;
+    cpuid(7, regs);
+    return (regs[1] & (1 << 8)) != 0;
+}
+
+// Returns true on AMD family 17h, that is Zen 1 and 2
+static bool cpu_is_zen2_or_older()
+{
+    int regs[4];
+    cpuid(0, regs);
+    // the vendor string is split over ebx, edx and ecx
+    bool amd = regs[1] == 0x68747541 && regs[3] == 0x69746e65 && regs[2] == 0x444d4163; // "AuthenticAMD"
+    cpuid(1, regs);
+    int family = ((regs[0] >> 8) & 0xf) + ((regs[0] >> 20) & 0xff);
+    return amd && family == 0x17;
+}
+#elif defined(BB_AVX2_KERNEL) || defined(BB_BMI2_KERNEL)
+static bool cpu_supports_avx2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static bool cpu_supports_bmi2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("bmi2");
+}
+
+static bool cpu_is_zen2_or_older()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_is("znver1") || __builtin_cpu_is("znver2");
+}
+#endif
+
+// Picks the fastest implementations the CPU supports. Must run before the tables are built.
+static void select_backend()
+{
+    bool avx2 = false;
+    bool bmi2 = false;
+#ifdef BB_AVX2_KERNEL
+    avx2 = cpu_supports_avx2() && backend_allows("avx2");
+    if (avx2)
+        backend.slider_flood = &slider_flood_avx2;
+#endif
+#ifdef BB_BMI2_KERNEL
+    // PEXT is microcoded on AMD before Zen 3, and much slower than a magic multiply there
+    bmi2 = cpu_supports_bmi2() && !cpu_is_zen2_or_older() && backend_allows("bmi2");
+    if (bmi2)
+    {
+        backend.rook_attacks = &rook_attacks_pext;
+        backend.bishop_attacks = &bishop_attacks_pext;
+    }
+#endif
+    backend.name = bmi2 && avx2 ? "bmi2+avx2" : bmi2 ? "bmi2" : avx2 ? "avx2" : "scalar";
+}
+
+static void init_all_magics()
+{
+    select_backend();
+#ifdef BB_BMI2_KERNEL
+    bool pext = backend.rook_attacks == &rook_attacks_pext;
+    init_magics(rook_magics, rook_magic_numbers, rook_table, pext ? rook_pext_table : NULL, &rook_flood);
+    init_magics(bishop_magics, bishop_magic_numbers, bishop_table, pext ? bishop_pext_table : NULL, &bishop_flood);
+#else
+    init_magics(rook_magics, rook_magic_numbers, rook_table, NULL, &rook_flood);
+    init_magics(bishop_magics, bishop_magic_numbers, bishop_table, NULL, &bishop_flood);
+#endif
+}
+
+void bb_init()
+{
+    call_once(&magics_once, &init_all_magics);
+}
+
+const char *bb_backend_name()
+{
+    bb_init();
+    return backend.name;
+}
+
+BitBoard bb_rook_attacks(int square, BitBoard occupied)
+{
+    return backend.rook_attacks(square, occupied);
+}
+
+BitBoard bb_bishop_attacks(int square, BitBoard occupied)
+{
+    return backend.bishop_attacks(square, occupied);
+}
+
+BitBoard bb_queen_attacks(int square, BitBoard occupied)
+{
+    return bb_rook_attacks(square, occupied) | bb_bishop_attacks(square, occupied);
+}
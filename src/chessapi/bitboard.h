@@ -24,6 +24,10 @@
 
 typedef uint64_t BitBoard;
 
+#if !defined(CHESS_PORTABLE_BITOPS) && defined(_MSC_VER) && defined(_M_X64)
+    #include <intrin.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -59,8 +63,23 @@ DLLEXPORT BitBoard bb_flood_sw(BitBoard board, BitBoard empty, bool captures);
 DLLEXPORT BitBoard bb_flood_w(BitBoard board, BitBoard empty, bool captures);
 DLLEXPORT BitBoard bb_flood_nw(BitBoard board, BitBoard empty, bool captures);
 
+// Multi-direction flood functions combine the directional floods in one call: the four orthogonal
+// directions (a rook's lines), the four diagonal directions (a bishop's), or all eight (a queen's).
+
+DLLEXPORT BitBoard bb_flood_orthogonal(BitBoard board, BitBoard empty, bool captures);
+DLLEXPORT BitBoard bb_flood_diagonal(BitBoard board, BitBoard empty, bool captures);
+DLLEXPORT BitBoard bb_flood_all(BitBoard board, BitBoard empty, bool captures);
+
+// Returns every square attacked by the rooks (or queens) on [orth] and the bishops (or queens) on [diag],
+// given the [empty] squares. This is the whole-board counterpart of the sliding attack lookups below.
+// The multi-direction functions use AVX2 to fill four directions at once when the CPU supports it,
+// once bb_init() has been called, see bb_backend_name(). Define CHESS_NO_AVX2 to build without it.
+
+DLLEXPORT BitBoard bb_slider_attacks(BitBoard orth, BitBoard diag, BitBoard empty);
+
 // Directional BitBoard blocker functions travel from position [board] in the given direction
 // until encountering an occluded space according to [empty], then returns this occluded space.
+// [board] should be a single square. If nothing occludes a full 7-square ray, the far edge square is returned.
 
 DLLEXPORT BitBoard bb_blocker_n(BitBoard board, BitBoard empty);
 DLLEXPORT BitBoard bb_blocker_ne(BitBoard board, BitBoard empty);
@@ -71,6 +90,101 @@ DLLEXPORT BitBoard bb_blocker_sw(BitBoard board, BitBoard empty);
 DLLEXPORT BitBoard bb_blocker_w(BitBoard board, BitBoard empty);
 DLLEXPORT BitBoard bb_blocker_nw(BitBoard board, BitBoard empty);
 
+// Sliding attack functions return every square a rook, bishop or queen standing on [square] attacks,
+// given the [occupied] squares. The first occupied square in each direction is included, whoever owns it.
+// These are table lookups, so they're much faster than combining the flood functions above.
+// The tables are built by bb_init(), which the chess API calls for you whenever a board is created.
+
+DLLEXPORT void bb_init();
+DLLEXPORT BitBoard bb_rook_attacks(int square, BitBoard occupied);
+DLLEXPORT BitBoard bb_bishop_attacks(int square, BitBoard occupied);
+DLLEXPORT BitBoard bb_queen_attacks(int square, BitBoard occupied);
+
+// The implementations above are picked by bb_init() to suit the CPU: PEXT lookups where BMI2 is fast, and
+// AVX2 for the multi-direction floods. Set the CHESS_BACKEND environment variable to limit the features
+// used, e.g. "avx2", "bmi2" or "scalar". Returns the chosen backend: "scalar", "bmi2", "avx2" or "bmi2+avx2".
+
+DLLEXPORT const char *bb_backend_name();
+
+// Bit scanning functions find set squares. These compile to single instructions (tzcnt, lzcnt, popcnt)
+// where the compiler supports it. Define CHESS_PORTABLE_BITOPS to use plain C instead.
+// bb_lsb(), bb_msb() and bb_pop_lsb() expect a non-empty [board].
+
+// Returns the index of the lowest set square on [board], so a1 before b1 before a2.
+static inline int bb_lsb(BitBoard board)
+{
+#if !defined(CHESS_PORTABLE_BITOPS) && (defined(__GNUC__) || defined(__clang__))
+    return __builtin_ctzll(board);
+#elif !defined(CHESS_PORTABLE_BITOPS) && defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, board);
+    return (int)index;
+#else
+    // de Bruijn multiplication on the isolated bit
+    static const int index64[64] = {
+        0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+        62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+        63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+        46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6};
+    return index64[((board & (~board + 1)) * 0x03f79d71b4cb0a89ull) >> 58];
+#endif
+}
+
+// Returns the index of the highest set square on [board], so h8 before g8 before h7.
+static inline int bb_msb(BitBoard board)
+{
+#if !defined(CHESS_PORTABLE_BITOPS) && (defined(__GNUC__) || defined(__clang__))
+    return 63 - __builtin_clzll(board);
+#elif !defined(CHESS_PORTABLE_BITOPS) && defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanReverse64(&index, board);
+    return (int)index;
+#else
+    // smear the highest bit downwards, then it's the lowest bit of what's left over
+    board |= board >> 1;
+    board |= board >> 2;
+    board |= board >> 4;
+    board |= board >> 8;
+    board |= board >> 16;
+    board |= board >> 32;
+    return bb_lsb(board ^ (board >> 1));
+#endif
+}
+
+// Removes the lowest set square from [*board] and returns its index.
+// Loop over every set square with: while (pieces) { int square = bb_pop_lsb(&pieces); ... }
+static inline int bb_pop_lsb(BitBoard *board)
+{
+    int index = bb_lsb(*board);
+    *board &= *board - 1;
+    return index;
+}
+
+// Returns the number of set squares on [board].
+static inline int bb_popcount(BitBoard board)
+{
+#if !defined(CHESS_PORTABLE_BITOPS) && (defined(__GNUC__) || defined(__clang__))
+    return __builtin_popcountll(board);
+#elif !defined(CHESS_PORTABLE_BITOPS) && defined(_MSC_VER) && defined(_M_X64)
+    return (int)__popcnt64(board);
+#else
+    board = board - ((board >> 1) & 0x5555555555555555ull);
+    board = (board & 0x3333333333333333ull) + ((board >> 2) & 0x3333333333333333ull);
+    board = (board + (board >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return (int)((board * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+// Writes the index of every set square on [board] to [squares], lowest first, and returns how many there were.
+// [squares] should hold at least bb_popcount(board) entries; 64 is always enough.
+static inline int bb_serialize(BitBoard board, int *squares)
+{
+    int count = 0;
+    while (board)
+        squares[count++] = bb_pop_lsb(&board);
+    return count;
+}
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -5,11 +5,51 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdatomic.h>
 #include <time.h>
+#include <limits.h>
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
 
 #define CHESS_BOT_NAME getenv("CHESS_BOT_NAME") ? getenv("CHESS_BOT_NAME") : "My Chess Bot"
 #define BOT_AUTHOR_NAME getenv("BOT_AUTHOR_NAME") ? getenv("BOT_AUTHOR_NAME") : "Author Name Here"
 
+// number of boards carved out of each pool slab, see alloc_board()
+#define BOARD_SLAB_SIZE 64
+// no position has more legal moves than this
+#define MAX_LEGAL_MOVES 256
+// value of the halfmove clock at which the 50-move rule draws. the clock counts plies, as in FEN
+#define FIFTY_MOVE_PLIES 100
+// most threads perft will split the root moves over, see chess_set_perft_threads()
+#define MAX_PERFT_THREADS 64
+// deepest the search goes, also the size of SearchResult.pv
+#define MAX_SEARCH_PLY 64
+// score of being mated right now, mates further away score less
+#define MATE_SCORE 32000
+// iteration depth used when chess_search() is given no limits at all
+#define DEFAULT_SEARCH_DEPTH 6
+// seed of the zobrist keys, see init_tables(). fixed so that keys match between runs, processes and machines
+#ifndef CHESS_ZOBRIST_SEED
+#define CHESS_ZOBRIST_SEED 0x9e3779b97f4a7c15ull
+#endif
+// half width of the first aspiration window, in centipawns
+#define ASPIRATION_WINDOW 50
+// extra depth taken off the search after a null move
+#define NULL_MOVE_REDUCTION 2
+// most threads a search will run, see chess_set_search_threads()
+#define MAX_SEARCH_THREADS 64
+// size of the transposition table a multi-threaded search makes if it isn't given one
+#define SMP_TT_SIZE_MB 16
+// entries per transposition table bucket, 4 entries of 16 bytes fill a 64 byte cache line
+#define TT_BUCKET_SLOTS 4
+// history scores are halved once one reaches this, so they stay below the killer move scores
+#define HISTORY_MAX (1 << 14)
+
 // ray direction constants (last 8 for knights)
 #define DIR_N 0
 #define DIR_NE 1
@@ -66,9 +106,12 @@ typedef struct
     // pthread_t uci_thread;
     thrd_t uci_thread;
     Board *shared_board;
+    char position_base[256];   // "startpos" or the FEN of the last position command, see uci_set_position()
+    char position_moves[4096]; // the moves of the last position command, space separated
+    size_t position_moves_len;
     uint64_t wtime;
     uint64_t btime;
-    clock_t turn_started_time;
+    uint64_t turn_started_micros; // monotonic_micros() when go was received
     Move latest_pushed_move;
     Move latest_opponent_move;
     // pthread_mutex_t mutex;
@@ -79,6 +122,38 @@ typedef struct
 
 typedef uint64_t BitBoard;
 
+// The state needed to take back one move, see make_move() and undo_move().
+// Pieces are given as zobrist piece indices, see get_piece_bitboard().
+typedef struct
+{
+    Move move;
+    int8_t moved;       // the moving piece, -1 if there was none
+    int8_t promoted;    // what the moving piece became, -1 if it was removed from the board
+    int8_t captured;    // the captured piece, -1 if there was none
+    int8_t captured_at; // the square of the captured piece
+    uint8_t castling;   // castling rights before the move, see get_castling_rights()
+    int halfmoves;
+    int repetition_window;
+    BitBoard en_passant_target;
+} UndoState;
+
+// A segment of move history. Cloned boards share segments, which are never modified while
+// shared: a board moving on from a shared segment starts a new one on top of it.
+// The zobrist key before each move is kept apart from the undo states, in an array right after
+// them, so repetition checks scan 8 bytes per move. See history_hashes().
+// Boards on different threads may share segments, so the refcount is atomic. A segment only its
+// owner references can't gain a reference from elsewhere, which lets the common unshared case
+// skip the read-modify-write, see release_history().
+typedef struct History History;
+struct History
+{
+    atomic_int refcount; // one per board or segment on top of this one
+    History *parent;   // older moves, or NULL
+    int parent_len;    // number of moves in the parent that belong under this segment
+    int capacity;
+    UndoState states[]; // oldest first, followed by capacity hashes
+};
+
 struct Board
 {
     BitBoard bb_white_pawn;
@@ -93,40 +168,112 @@ struct Board
     BitBoard bb_black_rook;
     BitBoard bb_black_queen;
     BitBoard bb_black_king;
-    BitBoard *bb_white_moves;
-    BitBoard *bb_black_moves;
+    AttackInfo attack_info; // cached check and pin information for the player to move, see get_attack_info()
+    bool attack_info_cached;
     bool whiteToMove;
-    int refcount;
-    Board *last_board; // for move undo
+    History *history; // for move undo, see push_history()
+    int history_len;  // number of moves in the top history segment that belong to this board
     BitBoard en_passant_target;
     bool can_castle_bq;
     bool can_castle_bk;
     bool can_castle_wq;
     bool can_castle_wk;
     int halfmoves;
+    int repetition_window; // moves since the last capture, pawn move or null move, see is_repetition()
     int fullmoves;
     uint64_t hash;
 };
 
 static InternalAPI *API = NULL;
 static uint64_t zobrist_keys[781];
-
-static int highest_bit(BitBoard v)
-{
-    const uint64_t b[] = {0x2, 0xC, 0xF0, 0xFF00, 0xFFFF0000, 0xFFFFFFFF00000000};
-    const uint64_t S[] = {1, 2, 4, 8, 16, 32};
-    int i;
-
-    uint64_t r = 0; // result of log2(v) will go here
-    for (i = 5; i >= 0; i--)
+static BitBoard dir_rays[8][64]; // every square reachable from a square in each DIR_* direction on an empty board
+static BitBoard rays_to[64][64]; // squares strictly between two squares sharing a line, 0 if they don't
+static BitBoard knight_moves[64];
+static BitBoard king_moves[64];
+static once_flag tables_once = ONCE_FLAG_INIT;
+
+// Returns the index of the highest set square of [v], or 0 if [v] is empty.
+static inline int highest_bit(BitBoard v)
+{
+    return v ? bb_msb(v) : 0;
+}
+
+// Returns the next number of the splitmix64 sequence for [state], advancing it.
+static uint64_t splitmix64(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// Returns a timestamp in microseconds from a monotonic clock, which is wall time unaffected by changes to the system clock.
+// Only the difference between two timestamps means anything.
+static uint64_t monotonic_micros()
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency, now;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+    // split so the multiply can't overflow
+    return (uint64_t)(now.QuadPart / frequency.QuadPart) * 1000000 + (uint64_t)(now.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#else
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#endif
+}
+
+// Builds the lookup tables used for move generation. Run once, see ensure_tables().
+static void init_tables()
+{
+    bb_init();
+    // setup zobrist keys here rather than with the UCI server, so every board is hashed with the same keys.
+    // the keys come from a fixed seed, so a key stays valid beyond the process that computed it
+    uint64_t seed = CHESS_ZOBRIST_SEED;
+    for (int i = 0; i < 781; i++)
+    {
+        zobrist_keys[i] = splitmix64(&seed);
+    }
+    BitBoard (*flood[])(BitBoard board, BitBoard empty, bool captures) = {&bb_flood_n, &bb_flood_ne, &bb_flood_e, &bb_flood_se, &bb_flood_s, &bb_flood_sw, &bb_flood_w, &bb_flood_nw};
+    for (int dir = 0; dir < 8; dir++)
     {
-        if (v & b[i])
+        for (int square = 0; square < 64; square++)
         {
-            v >>= S[i];
-            r |= S[i];
+            dir_rays[dir][square] = (*flood[dir])(((BitBoard)1) << square, ~0ull, true);
         }
     }
-    return (int)r;
+    for (int dir = 0; dir < 8; dir++)
+    {
+        for (int square = 0; square < 64; square++)
+        {
+            BitBoard ends = (((BitBoard)1) << square);
+            for (BitBoard targets = dir_rays[dir][square] & ~ends; targets; targets &= targets - 1)
+            {
+                int target = bb_lsb(targets);
+                rays_to[square][target] = dir_rays[dir][square] & ~dir_rays[dir][target] & ~ends & ~(targets & -targets);
+            }
+        }
+    }
+    for (int square = 0; square < 64; square++)
+    {
+        BitBoard piece = ((BitBoard)1) << square;
+        BitBoard horz = piece | bb_slide_e(piece) | bb_slide_w(piece);
+        king_moves[square] = (horz | bb_slide_n(horz) | bb_slide_s(horz)) ^ piece;
+        BitBoard one_over = bb_slide_e(piece) | bb_slide_w(piece);
+        BitBoard two_over = bb_slide_e(bb_slide_e(piece)) | bb_slide_w(bb_slide_w(piece));
+        knight_moves[square] = bb_slide_n(bb_slide_n(one_over)) | bb_slide_s(bb_slide_s(one_over)) | bb_slide_n(two_over) | bb_slide_s(two_over);
+    }
+}
+
+// Makes sure the lookup tables are ready. Safe to call from any thread, any number of times.
+static void ensure_tables()
+{
+    call_once(&tables_once, &init_tables);
 }
 
 PieceType chess_get_piece_from_index(Board *board, int index)
@@ -177,17 +324,6 @@ BitBoard chess_get_bitboard_from_index(int index)
     return ((BitBoard)1) << index;
 }
 
-static uint64_t rand_uint64_t()
-{
-    return ((uint64_t)rand()) ^ (((uint64_t)rand()) << 16) ^ (((uint64_t)rand()) << 32) ^ (((uint64_t)rand()) << 48);
-}
-
-// Returns true if the boards are equal.
-static bool board_equals(Board *board1, Board *board2)
-{
-    return (board1->hash == board2->hash) && (board1->whiteToMove == board2->whiteToMove) && (board1->bb_white_pawn == board2->bb_white_pawn) && (board1->bb_black_pawn == board2->bb_black_pawn) && (board1->bb_white_queen == board2->bb_white_queen) && (board1->bb_black_queen == board2->bb_black_queen) && (board1->bb_white_knight == board2->bb_white_knight) && (board1->bb_black_knight == board2->bb_black_knight) && (board1->bb_white_bishop == board2->bb_white_bishop) && (board1->bb_black_bishop == board2->bb_black_bishop) && (board1->bb_white_rook == board2->bb_white_rook) && (board1->bb_black_rook == board2->bb_black_rook) && (board1->bb_white_king == board2->bb_white_king) && (board1->bb_black_king == board2->bb_black_king) && (board1->can_castle_bk == board2->can_castle_bk) && (board1->can_castle_bq == board2->can_castle_bq) && (board1->can_castle_wk == board2->can_castle_wk) && (board1->can_castle_wq == board2->can_castle_wq) && (board1->en_passant_target == board2->en_passant_target);
-}
-
 // creates a Move from a [movestr] in standard game notation and returns it
 // if [board] is given, will augment move with flags; NULL is okay too
 static Move load_move(char *movestr, Board *board)
@@ -273,85 +409,282 @@ static void dump_move(char *buffer, Move move)
     }
 }
 
-// Safely free a board from memory.
-static void free_board(Board *board)
+// Drops a reference to [history], freeing any segments no longer in use.
+static void release_history(History *history)
 {
-    board->refcount--;
-    if (board->refcount > 0)
-        return;
-    if (board->bb_white_moves != NULL)
+    // the acquire load pairs with the release in other threads' decrements, so their reads of
+    // the segment are done before it's freed or written to again
+    while (history != NULL && (atomic_load_explicit(&history->refcount, memory_order_acquire) == 1 ||
+                               atomic_fetch_sub_explicit(&history->refcount, 1, memory_order_acq_rel) == 1))
+    {
+        History *parent = history->parent;
+        free(history);
+        history = parent;
+    }
+}
+
+// Adds a reference to [history], if there is one.
+static void share_history(History *history)
+{
+    // relaxed is enough: the new reference comes from an existing one, which keeps the segment alive meanwhile
+    if (history != NULL)
+        atomic_fetch_add_explicit(&history->refcount, 1, memory_order_relaxed);
+}
+
+// Returns the zobrist keys of the positions before each move of [history], oldest first.
+static uint64_t *history_hashes(History *history)
+{
+    return (uint64_t *)&history->states[history->capacity];
+}
+
+// Adds a record to the history of [board] and returns it for the caller to fill in.
+// The board's current zobrist key is recorded with it.
+static UndoState *push_history(Board *board)
+{
+    History *history = board->history;
+    if (history == NULL || atomic_load_explicit(&history->refcount, memory_order_acquire) > 1)
+    {
+        // can't write to a shared segment, so start a new one. our reference becomes its parent link
+        History *segment = (History *)malloc(sizeof(History) + 16 * (sizeof(UndoState) + sizeof(uint64_t)));
+        atomic_init(&segment->refcount, 1);
+        segment->parent = history;
+        segment->parent_len = board->history_len;
+        segment->capacity = 16;
+        board->history = segment;
+        board->history_len = 0;
+    }
+    else if (board->history_len == history->capacity)
+    {
+        history->capacity *= 2;
+        history = (History *)realloc(history, sizeof(History) + history->capacity * (sizeof(UndoState) + sizeof(uint64_t)));
+        // the hashes were right after the old capacity of states, move them past the new one
+        memmove(history_hashes(history), &history->states[history->capacity / 2], history->capacity / 2 * sizeof(uint64_t));
+        board->history = history;
+    }
+    history_hashes(board->history)[board->history_len] = board->hash;
+    return &board->history->states[board->history_len++];
+}
+
+// Removes the latest record from the history of [board], storing it in [state] and the zobrist key recorded with it in [hash].
+// Returns false if there are no moves to remove.
+static bool pop_history(Board *board, UndoState *state, uint64_t *hash)
+{
+    while (board->history != NULL && board->history_len == 0)
     {
-        free(board->bb_white_moves);
+        // step down to the parent segment
+        History *segment = board->history;
+        board->history = segment->parent;
+        board->history_len = segment->parent_len;
+        share_history(board->history);
+        release_history(segment);
     }
-    if (board->bb_black_moves != NULL)
+    if (board->history == NULL)
+        return false;
+    *state = board->history->states[--board->history_len];
+    *hash = history_hashes(board->history)[board->history_len];
+    return true;
+}
+
+// A free slot in the board pool. Slots are reused for the life of the process, even after the thread holding them exits, see alloc_board().
+typedef union PooledBoard PooledBoard;
+union PooledBoard
+{
+    Board board;
+    PooledBoard *next_free;
+};
+
+static atomic_size_t pool_live_boards = 0;
+static atomic_size_t pool_peak_boards = 0;
+static atomic_size_t pool_slab_boards = 0;
+#if defined(CHESS_BOARD_POOL_GLOBAL)
+// one free list for every thread, for when boards are mostly freed on a different thread than they're made on
+static PooledBoard *pool_free_list = NULL;
+static mtx_t pool_mutex;
+static once_flag pool_once = ONCE_FLAG_INIT;
+static void init_pool_mutex()
+{
+    mtx_init(&pool_mutex, mtx_plain);
+}
+#elif !defined(CHESS_BOARD_POOL_DISABLED)
+// each thread keeps its own free list, so no locking is needed. a board freed on another thread
+// simply joins that thread's list
+static _Thread_local PooledBoard *pool_free_list = NULL;
+static _Thread_local bool pool_thread_registered = false;
+// the free lists of exited threads, taken over by the next thread to run out of slots
+static PooledBoard *pool_orphans = NULL;
+static mtx_t pool_orphans_mutex;
+static tss_t pool_thread_key;
+static once_flag pool_once = ONCE_FLAG_INIT;
+
+// Called as a thread exits with its pool_free_list, which is handed to pool_orphans rather than lost with the thread.
+static void release_thread_pool(void *free_list)
+{
+    PooledBoard *head = *(PooledBoard **)free_list;
+    *(PooledBoard **)free_list = NULL;
+    pool_thread_registered = false; // boards freed later in the exit register again
+    if (head == NULL)
+        return;
+    PooledBoard *tail = head;
+    while (tail->next_free != NULL)
+        tail = tail->next_free;
+    mtx_lock(&pool_orphans_mutex);
+    tail->next_free = pool_orphans;
+    pool_orphans = head;
+    mtx_unlock(&pool_orphans_mutex);
+}
+
+static void init_pool()
+{
+    mtx_init(&pool_orphans_mutex, mtx_plain);
+    tss_create(&pool_thread_key, &release_thread_pool);
+}
+
+// Makes sure release_thread_pool() runs when the calling thread exits.
+static void register_pool_thread()
+{
+    if (pool_thread_registered)
+        return;
+    call_once(&pool_once, &init_pool);
+    tss_set(pool_thread_key, &pool_free_list);
+    pool_thread_registered = true;
+}
+#endif
+
+// Records a board being handed out for the pool statistics.
+static void count_board_alloc()
+{
+    size_t live = atomic_fetch_add_explicit(&pool_live_boards, 1, memory_order_relaxed) + 1;
+    size_t peak = atomic_load_explicit(&pool_peak_boards, memory_order_relaxed);
+    while (live > peak && !atomic_compare_exchange_weak_explicit(&pool_peak_boards, &peak, live, memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+// Returns uninitialised memory for a board, taken from the pool where possible.
+static Board *alloc_board()
+{
+    count_board_alloc();
+#if defined(CHESS_BOARD_POOL_DISABLED)
+    return (Board *)malloc(sizeof(Board));
+#else
+#if defined(CHESS_BOARD_POOL_GLOBAL)
+    call_once(&pool_once, &init_pool_mutex);
+    mtx_lock(&pool_mutex);
+#else
+    register_pool_thread();
+    if (pool_free_list == NULL)
     {
-        free(board->bb_black_moves);
+        // adopt up to a slab's worth of the slots of exited threads before making more, leaving the rest for other threads
+        mtx_lock(&pool_orphans_mutex);
+        PooledBoard *tail = pool_orphans;
+        for (int i = 1; tail != NULL && i < BOARD_SLAB_SIZE && tail->next_free != NULL; i++)
+            tail = tail->next_free;
+        if (tail != NULL)
+        {
+            pool_free_list = pool_orphans;
+            pool_orphans = tail->next_free;
+            tail->next_free = NULL;
+        }
+        mtx_unlock(&pool_orphans_mutex);
     }
-    if (board->last_board != NULL)
+#endif
+    if (pool_free_list == NULL)
     {
-        free_board(board->last_board);
+        // out of slots, carve up a new slab
+        PooledBoard *slab = (PooledBoard *)malloc(BOARD_SLAB_SIZE * sizeof(PooledBoard));
+        for (int i = 0; i < BOARD_SLAB_SIZE - 1; i++)
+            slab[i].next_free = &slab[i + 1];
+        slab[BOARD_SLAB_SIZE - 1].next_free = NULL;
+        pool_free_list = slab;
+        atomic_fetch_add_explicit(&pool_slab_boards, BOARD_SLAB_SIZE, memory_order_relaxed);
     }
+    PooledBoard *slot = pool_free_list;
+    pool_free_list = slot->next_free;
+#if defined(CHESS_BOARD_POOL_GLOBAL)
+    mtx_unlock(&pool_mutex);
+#endif
+    return &slot->board;
+#endif
+}
+
+// Safely free a board from memory.
+static void free_board(Board *board)
+{
+    release_history(board->history);
+    atomic_fetch_sub_explicit(&pool_live_boards, 1, memory_order_relaxed);
+#if defined(CHESS_BOARD_POOL_DISABLED)
     free(board);
+#else
+    PooledBoard *slot = (PooledBoard *)board;
+#if defined(CHESS_BOARD_POOL_GLOBAL)
+    mtx_lock(&pool_mutex);
+#else
+    register_pool_thread();
+#endif
+    slot->next_free = pool_free_list;
+    pool_free_list = slot;
+#if defined(CHESS_BOARD_POOL_GLOBAL)
+    mtx_unlock(&pool_mutex);
+#endif
+#endif
+}
+
+// Returns the bitboard on [board] for the zobrist piece index [piece].
+static BitBoard *get_piece_bitboard(Board *board, int piece)
+{
+    switch (piece)
+    {
+    case 0:
+        return &board->bb_black_pawn;
+    case 1:
+        return &board->bb_black_rook;
+    case 2:
+        return &board->bb_black_bishop;
+    case 3:
+        return &board->bb_black_queen;
+    case 4:
+        return &board->bb_black_king;
+    case 5:
+        return &board->bb_black_knight;
+    case 6:
+        return &board->bb_white_pawn;
+    case 7:
+        return &board->bb_white_rook;
+    case 8:
+        return &board->bb_white_bishop;
+    case 9:
+        return &board->bb_white_queen;
+    case 10:
+        return &board->bb_white_king;
+    default:
+        return &board->bb_white_knight;
+    }
+}
+
+// Returns the zobrist piece index of the piece on [square] on [board], or -1 if it's empty.
+static int get_piece_at(Board *board, BitBoard square)
+{
+    for (int piece = 0; piece < 12; piece++)
+    {
+        if (*get_piece_bitboard(board, piece) & square)
+            return piece;
+    }
+    return -1;
 }
 
-static void set_board_from(Board *dest, Board *src)
+// Packs the castling rights of [board] into the low 4 bits of a byte.
+static uint8_t get_castling_rights(Board *board)
 {
-    dest->bb_black_bishop = src->bb_black_bishop;
-    dest->bb_black_rook = src->bb_black_rook;
-    dest->bb_black_queen = src->bb_black_queen;
-    dest->bb_black_king = src->bb_black_king;
-    dest->bb_black_knight = src->bb_black_knight;
-    dest->bb_black_pawn = src->bb_black_pawn;
-    dest->bb_white_bishop = src->bb_white_bishop;
-    dest->bb_white_rook = src->bb_white_rook;
-    dest->bb_white_queen = src->bb_white_queen;
-    dest->bb_white_king = src->bb_white_king;
-    dest->bb_white_knight = src->bb_white_knight;
-    dest->bb_white_pawn = src->bb_white_pawn;
+    return board->can_castle_bk | (board->can_castle_bq << 1) | (board->can_castle_wk << 2) | (board->can_castle_wq << 3);
 }
 
 // Set the Zobrist hash for [board] from its current position
 static void calc_zobrist(Board *board)
 {
     uint64_t hash = 0;
-    BitBoard board0 = board->bb_black_pawn;
-    BitBoard board1 = board->bb_black_rook;
-    BitBoard board2 = board->bb_black_bishop;
-    BitBoard board3 = board->bb_black_queen;
-    BitBoard board4 = board->bb_black_king;
-    BitBoard board5 = board->bb_black_knight;
-    BitBoard board6 = board->bb_white_pawn;
-    BitBoard board7 = board->bb_white_rook;
-    BitBoard board8 = board->bb_white_bishop;
-    BitBoard board9 = board->bb_white_queen;
-    BitBoard board10 = board->bb_white_king;
-    BitBoard board11 = board->bb_white_knight;
-    for (int i = 0; i < 64; i++)
-    {
-        hash ^= (board0 & 1) * zobrist_keys[0 * 64 + i];
-        hash ^= (board1 & 1) * zobrist_keys[1 * 64 + i];
-        hash ^= (board2 & 1) * zobrist_keys[2 * 64 + i];
-        hash ^= (board3 & 1) * zobrist_keys[3 * 64 + i];
-        hash ^= (board4 & 1) * zobrist_keys[4 * 64 + i];
-        hash ^= (board5 & 1) * zobrist_keys[5 * 64 + i];
-        hash ^= (board6 & 1) * zobrist_keys[6 * 64 + i];
-        hash ^= (board7 & 1) * zobrist_keys[7 * 64 + i];
-        hash ^= (board8 & 1) * zobrist_keys[8 * 64 + i];
-        hash ^= (board9 & 1) * zobrist_keys[9 * 64 + i];
-        hash ^= (board10 & 1) * zobrist_keys[10 * 64 + i];
-        hash ^= (board11 & 1) * zobrist_keys[11 * 64 + i];
-        board0 >>= 1;
-        board1 >>= 1;
-        board2 >>= 1;
-        board3 >>= 1;
-        board4 >>= 1;
-        board5 >>= 1;
-        board6 >>= 1;
-        board7 >>= 1;
-        board8 >>= 1;
-        board9 >>= 1;
-        board10 >>= 1;
-        board11 >>= 1;
+    for (int piece = 0; piece < 12; piece++)
+    {
+        for (BitBoard pieces = *get_piece_bitboard(board, piece); pieces; pieces &= pieces - 1)
+            hash ^= zobrist_keys[64 * piece + bb_lsb(pieces)];
     }
     if (board->can_castle_bk)
         hash ^= zobrist_keys[768];
@@ -368,7 +701,7 @@ static void calc_zobrist(Board *board)
     board->hash = hash;
 }
 
-// Clears all piece bitboards for the [board], and clears the pseudo-legal move caches.
+// Clears all piece bitboards for the [board], and clears the attack info cache.
 static void clear_board(Board *board)
 {
     board->bb_black_bishop = 0;
@@ -377,26 +710,45 @@ static void clear_board(Board *board)
     board->bb_black_rook = 0;
     board->bb_black_pawn = 0;
     board->bb_black_knight = 0;
-    if (board->bb_black_moves != NULL)
-    {
-        free(board->bb_black_moves);
-        board->bb_black_moves = 0;
-    }
     board->bb_white_bishop = 0;
     board->bb_white_king = 0;
     board->bb_white_queen = 0;
     board->bb_white_rook = 0;
     board->bb_white_pawn = 0;
     board->bb_white_knight = 0;
-    if (board->bb_white_moves != NULL)
+    board->attack_info_cached = false;
+    calc_zobrist(board);
+}
+
+// Returns [fen] moved to the start of its next space-separated field, or to the end of the string if there are none.
+static const char *next_fen_field(const char *fen)
+{
+    while (*fen != ' ' && *fen != '\0')
+        fen++;
+    while (*fen == ' ')
+        fen++;
+    return fen;
+}
+
+// Reads the digits at the start of [fen] into [value]. Returns false if there are none or the number is unreasonably large.
+static bool parse_fen_number(const char *fen, int *value)
+{
+    if (*fen < '0' || *fen > '9')
+        return false;
+    *value = 0;
+    while (*fen >= '0' && *fen <= '9')
     {
-        free(board->bb_white_moves);
-        board->bb_white_moves = 0;
+        *value = *value * 10 + (*fen - '0');
+        if (*value > 1000000)
+            return false;
+        fen++;
     }
-    calc_zobrist(board);
+    return *fen == ' ' || *fen == '\0';
 }
 
-static void set_board_from_fen(Board *board, const char *fen)
+// Sets up [board] from [fen], or the starting position if [fen] is NULL.
+// Returns false if [fen] is malformed or describes an impossible position, in which case [board] holds no usable position.
+static bool set_board_from_fen(Board *board, const char *fen)
 {
     // if no fen given, use starting pos
     const char *use_fen = (fen != NULL) ? fen : "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
@@ -405,136 +757,119 @@ static void set_board_from_fen(Board *board, const char *fen)
     board->can_castle_bq = false;
     board->can_castle_wk = false;
     board->can_castle_wq = false;
-    BitBoard place_piece = ((BitBoard)1) << 56;
-    while (*use_fen != ' ')
+    while (*use_fen == ' ')
+        use_fen++;
+    // ranks from 8 down to 1, each filled from the a file
+    int rank = 7;
+    int file = 0;
+    bool after_count = false;
+    while (*use_fen != ' ' && *use_fen != '\0')
     {
-        switch (*use_fen)
-        {
-        case 'r':
-            board->bb_black_rook |= place_piece;
-            break;
-        case 'n':
-            board->bb_black_knight |= place_piece;
-            break;
-        case 'b':
-            board->bb_black_bishop |= place_piece;
-            break;
-        case 'q':
-            board->bb_black_queen |= place_piece;
-            break;
-        case 'k':
-            board->bb_black_king |= place_piece;
-            break;
-        case 'p':
-            board->bb_black_pawn |= place_piece;
-            break;
-        case 'R':
-            board->bb_white_rook |= place_piece;
-            break;
-        case 'N':
-            board->bb_white_knight |= place_piece;
-            break;
-        case 'B':
-            board->bb_white_bishop |= place_piece;
-            break;
-        case 'Q':
-            board->bb_white_queen |= place_piece;
-            break;
-        case 'K':
-            board->bb_white_king |= place_piece;
-            break;
-        case 'P':
-            board->bb_white_pawn |= place_piece;
-            break;
-        case '/':
-            break;
-        default:
-        {
-            char spaces = *use_fen - '0';
-            place_piece <<= (spaces - 1);
-        }
-        break;
-        }
-        if (*use_fen == '/')
+        char c = *use_fen++;
+        if (c == '/')
         {
-            use_fen++;
-            place_piece >>= 7;
-            place_piece = bb_slide_s(place_piece);
+            after_count = false;
+            if (file != 8 || rank == 0)
+                return false;
+            rank--;
+            file = 0;
             continue;
         }
-        use_fen++;
-        if (highest_bit(place_piece) % 8 < 7)
+        if (c >= '1' && c <= '8')
         {
-            place_piece = bb_slide_e(place_piece);
+            // two counts in a row, like "44", aren't valid FEN
+            if (after_count)
+                return false;
+            after_count = true;
+            file += c - '0';
+            if (file > 8)
+                return false;
+            continue;
         }
+        const char *piece_chars = "prbqknPRBQKN"; // in zobrist piece index order, see get_piece_bitboard()
+        const char *piece = strchr(piece_chars, c);
+        if (piece == NULL || file >= 8)
+            return false;
+        *get_piece_bitboard(board, (int)(piece - piece_chars)) |= ((BitBoard)1) << (8 * rank + file);
+        file++;
+        after_count = false;
     }
-    use_fen++;
+    if (rank != 0 || file != 8)
+        return false;
+    // exactly one king each, and no pawns on the first or last rank
+    BitBoard back_ranks = 0xff000000000000ffull;
+    if (bb_popcount(board->bb_white_king) != 1 || bb_popcount(board->bb_black_king) != 1)
+        return false;
+    if ((board->bb_white_pawn | board->bb_black_pawn) & back_ranks)
+        return false;
+    use_fen = next_fen_field(use_fen);
+    if ((*use_fen != 'w' && *use_fen != 'b') || (use_fen[1] != ' ' && use_fen[1] != '\0'))
+        return false;
     board->whiteToMove = (*use_fen == 'w');
-    use_fen += 2;
-    while (*use_fen != ' ')
+    use_fen = next_fen_field(use_fen);
+    if (*use_fen == '-')
+        use_fen++;
+    else
     {
-        switch (*use_fen)
+        while (*use_fen != ' ' && *use_fen != '\0')
         {
-        case 'K':
-            board->can_castle_wk = true;
-            break;
-        case 'Q':
-            board->can_castle_wq = true;
-            break;
-        case 'k':
-            board->can_castle_bk = true;
-            break;
-        case 'q':
-            board->can_castle_bq = true;
-            break;
+            switch (*use_fen)
+            {
+            case 'K':
+                board->can_castle_wk = true;
+                break;
+            case 'Q':
+                board->can_castle_wq = true;
+                break;
+            case 'k':
+                board->can_castle_bk = true;
+                break;
+            case 'q':
+                board->can_castle_bq = true;
+                break;
+            default:
+                return false;
+            }
+            use_fen++;
         }
-        use_fen++;
     }
-    use_fen++;
-    BitBoard ep_square = 1;
-    while (*use_fen != ' ')
+    if (*use_fen != ' ' && *use_fen != '\0')
+        return false;
+    use_fen = next_fen_field(use_fen);
+    BitBoard ep_square = 0;
+    if (*use_fen >= 'a' && *use_fen <= 'h' && (use_fen[1] == '3' || use_fen[1] == '6'))
     {
-        if (*use_fen == '-')
-        {
-            ep_square = 0;
-            break;
-        }
-        else if (*use_fen >= 'a' && *use_fen <= 'h')
-        {
-            ep_square <<= (*use_fen - 'a');
-        }
-        else if (*use_fen >= '1' && *use_fen <= '7')
-        {
-            ep_square <<= (8 * (*use_fen - '1'));
-        }
-        use_fen++;
+        ep_square = ((BitBoard)1) << (8 * (use_fen[1] - '1') + (use_fen[0] - 'a'));
+        use_fen += 2;
     }
-    use_fen++;
+    else if (*use_fen == '-')
+        use_fen++;
+    else if (*use_fen != '\0') // the fields after the placement and side to move are optional
+        return false;
+    if (*use_fen != ' ' && *use_fen != '\0')
+        return false;
     board->en_passant_target = ep_square;
+    // the move counters are optional
+    use_fen = next_fen_field(use_fen);
     int halfmoves = 0;
-    while (*use_fen != ' ')
-    {
-        halfmoves *= 10;
-        halfmoves += *use_fen - '0';
-        use_fen++;
-    }
-    use_fen++;
+    if (*use_fen != '\0' && !parse_fen_number(use_fen, &halfmoves))
+        return false;
     board->halfmoves = halfmoves;
-    int fullmoves = 0;
-    while (*use_fen != ' ')
-    {
-        fullmoves *= 10;
-        fullmoves += *use_fen - '0';
-        use_fen++;
-    }
-    board->fullmoves = fullmoves;
+    board->repetition_window = halfmoves;
+    use_fen = next_fen_field(use_fen);
+    int fullmoves = 1;
+    if (*use_fen != '\0' && !parse_fen_number(use_fen, &fullmoves))
+        return false;
+    board->fullmoves = fullmoves > 0 ? fullmoves : 1;
     calc_zobrist(board);
+    return true;
 }
 
 // Makes a new, blank board. Caller responsible for freeing.
 static Board *create_board()
 {
-    Board *board = (Board *)malloc(sizeof(Board));
+    ensure_tables();
+    Board *board = alloc_board();
     memset(board, 0, sizeof(Board));
     clear_board(board);
     board->can_castle_bk = false;
@@ -543,26 +878,24 @@ static Board *create_board()
     board->can_castle_wq = false;
     board->fullmoves = 1;
     board->halfmoves = 0;
-    board->last_board = NULL;
+    board->repetition_window = 0;
     board->en_passant_target = 0;
     board->whiteToMove = true;
-    board->refcount = 1;
     return board;
 }
 
-// Creates a shallow copy of the given board
+// Copies [board] into [dest], sharing its move history. The history of [dest] must be released with release_history() when done.
+static void copy_board(Board *dest, Board *board)
+{
+    memcpy(dest, board, sizeof(Board)); // attack caches stay valid, it's the same position
+    share_history(dest->history);
+}
+
+// Creates a shallow copy of the given board, sharing its move history
 static Board *clone_board(Board *board)
 {
-    Board *new_board = (Board *)malloc(sizeof(Board));
-    memcpy(new_board, board, sizeof(Board));
-    new_board->bb_black_moves = NULL;
-    new_board->bb_white_moves = NULL;
-    new_board->refcount = 1;
-    // new_board->last_board = NULL;
-    if (new_board->last_board != NULL)
-    {
-        new_board->last_board->refcount++;
-    }
+    Board *new_board = alloc_board();
+    copy_board(new_board, board);
     return new_board;
 }
 
@@ -571,37 +904,40 @@ static Board *clone_board(Board *board)
 // Moves are presumed legal.
 static void make_move(Board *board, Move move)
 {
-    Board *saved_board = clone_board(board);             // note: makes a new ref to the board history
-    saved_board->bb_black_moves = board->bb_black_moves; // transfer our caches to the clone
-    saved_board->bb_white_moves = board->bb_white_moves; // transfer our caches to the clone
-    board->bb_black_moves = NULL;                        // remove caches from current board (move invalidates)
-    board->bb_white_moves = NULL;                        // remove caches from current board (move invalidates)
-    // saved_board->last_board = board->last_board;  // should be unnecessary
-    if (board->last_board)
-        free_board(board->last_board); // adjust refcount since we're removing a reference
-    board->last_board = saved_board;
+    UndoState *undo = push_history(board);
+    undo->move = move;
+    undo->moved = (int8_t)get_piece_at(board, move.from);
+    undo->promoted = undo->moved;
+    undo->captured = -1;
+    undo->castling = get_castling_rights(board);
+    undo->halfmoves = board->halfmoves;
+    undo->repetition_window = board->repetition_window;
+    undo->en_passant_target = board->en_passant_target;
+    board->attack_info_cached = false; // move invalidates cache
     int from = highest_bit(move.from);
     int to = highest_bit(move.to);
     uint64_t hash = board->hash;
     board->halfmoves++;
+    // nothing before a null move can repeat after it in a real game, see is_repetition()
+    board->repetition_window = (move.from != 0) ? board->repetition_window + 1 : 0;
     BitBoard flip_pieces = move.to | move.from;
-    hash ^= highest_bit(board->en_passant_target) % 8; // xor out the old en passant hash
+    if (board->en_passant_target)
+        hash ^= zobrist_keys[773 + highest_bit(board->en_passant_target) % 8]; // xor out the old en passant hash
     bool do_promotion = false;
     bool pawn_move = (move.from & (board->bb_black_pawn | board->bb_white_pawn)) > 0;
     bool en_passant = pawn_move && ((board->en_passant_target & move.to) > 0);
     if (pawn_move)
     {
         board->halfmoves = 0;
+        board->repetition_window = 0;
         // set en passant target if double pawn move
         if ((move.to & bb_slide_s(bb_slide_s(move.from))) > 0)
         {
             board->en_passant_target = bb_slide_s(move.from);
-            hash ^= highest_bit(board->en_passant_target) % 8; // xor in new en passant hash
         }
         else if ((move.to & bb_slide_n(bb_slide_n(move.from))) > 0)
         {
             board->en_passant_target = bb_slide_n(move.from);
-            hash ^= highest_bit(board->en_passant_target) % 8; // xor in new en passant hash
         }
         else if (!en_passant)
         {
@@ -690,7 +1026,7 @@ static void make_move(Board *board, Move move)
         else if ((move.from & board->bb_black_king) > 0 && (move.to > move.from))
         {
             // black castle kingside
-            hash ^= zobrist_keys[64 * 10 + 56 + 4] ^ zobrist_keys[64 * 10 + 56 + 6] ^ zobrist_keys[64 * 7 + 56 + 7] ^ zobrist_keys[64 * 7 + 56 + 5];
+            hash ^= zobrist_keys[64 * 4 + 56 + 4] ^ zobrist_keys[64 * 4 + 56 + 6] ^ zobrist_keys[64 * 1 + 56 + 7] ^ zobrist_keys[64 * 1 + 56 + 5];
             if (board->can_castle_bk)
                 hash ^= zobrist_keys[768];
             if (board->can_castle_bq)
@@ -703,7 +1039,7 @@ static void make_move(Board *board, Move move)
         else if ((move.from & board->bb_black_king) > 0 && (move.to < move.from))
         {
             // black castle queenside
-            hash ^= zobrist_keys[64 * 10 + 56 + 4] ^ zobrist_keys[64 * 10 + 56 + 2] ^ zobrist_keys[64 * 7 + 56 + 0] ^ zobrist_keys[64 * 7 + 56 + 3];
+            hash ^= zobrist_keys[64 * 4 + 56 + 4] ^ zobrist_keys[64 * 4 + 56 + 2] ^ zobrist_keys[64 * 1 + 56 + 0] ^ zobrist_keys[64 * 1 + 56 + 3];
             if (board->can_castle_bk)
                 hash ^= zobrist_keys[768];
             if (board->can_castle_bq)
@@ -725,6 +1061,7 @@ static void make_move(Board *board, Move move)
     if (move.capture)
     {
         board->halfmoves = 0;
+        board->repetition_window = 0;
         BitBoard cap_mask;
         // note: since en passant must be performed the turn after the double pawn move,
         // there is never a case where an en passant move could capture two pieces
@@ -747,6 +1084,8 @@ static void make_move(Board *board, Move move)
         // update hash for captured piece
         BitBoard inv_cap_mask = ~cap_mask;
         int cap_at = highest_bit(inv_cap_mask);
+        undo->captured = (int8_t)get_piece_at(board, inv_cap_mask);
+        undo->captured_at = (int8_t)cap_at;
         hash ^= ((board->bb_black_pawn & inv_cap_mask) > 0) * (zobrist_keys[64 * 0 + cap_at]);
         hash ^= ((board->bb_black_rook & inv_cap_mask) > 0) * (zobrist_keys[64 * 1 + cap_at]);
         hash ^= ((board->bb_black_bishop & inv_cap_mask) > 0) * (zobrist_keys[64 * 2 + cap_at]);
@@ -801,36 +1140,41 @@ static void make_move(Board *board, Move move)
     board->bb_white_pawn ^= ((board->bb_white_pawn & move.from) > 0) * flip_pieces;
     if (do_promotion)
     {
+        undo->promoted = -1; // the pawn is removed even if no valid promotion is given
+        if (move.promotion >= BISHOP && move.promotion <= QUEEN)
+            undo->promoted = (int8_t)get_piece_at(board, move.to) + (move.promotion == ROOK ? 1 : move.promotion == BISHOP ? 2 : move.promotion == QUEEN ? 3 : 5);
         switch (move.promotion)
         {
         case BISHOP:
             board->bb_white_bishop |= (move.to & board->bb_white_pawn);
             board->bb_black_bishop |= (move.to & board->bb_black_pawn);
-            hash ^= (move.to & board->bb_white_pawn) * (zobrist_keys[64 * 8 + to] + zobrist_keys[64 * 6 + to]);
-            hash ^= (move.to & board->bb_black_pawn) * (zobrist_keys[64 * 2 + to] + zobrist_keys[64 * 0 + to]);
+            hash ^= ((move.to & board->bb_white_pawn) > 0) * (zobrist_keys[64 * 8 + to] ^ zobrist_keys[64 * 6 + to]);
+            hash ^= ((move.to & board->bb_black_pawn) > 0) * (zobrist_keys[64 * 2 + to] ^ zobrist_keys[64 * 0 + to]);
             break;
         case ROOK:
             board->bb_white_rook |= (move.to & board->bb_white_pawn);
             board->bb_black_rook |= (move.to & board->bb_black_pawn);
-            hash ^= (move.to & board->bb_white_pawn) * (zobrist_keys[64 * 7 + to] + zobrist_keys[64 * 6 + to]);
-            hash ^= (move.to & board->bb_black_pawn) * (zobrist_keys[64 * 1 + to] + zobrist_keys[64 * 0 + to]);
+            hash ^= ((move.to & board->bb_white_pawn) > 0) * (zobrist_keys[64 * 7 + to] ^ zobrist_keys[64 * 6 + to]);
+            hash ^= ((move.to & board->bb_black_pawn) > 0) * (zobrist_keys[64 * 1 + to] ^ zobrist_keys[64 * 0 + to]);
             break;
         case KNIGHT:
             board->bb_white_knight |= (move.to & board->bb_white_pawn);
             board->bb_black_knight |= (move.to & board->bb_black_pawn);
-            hash ^= (move.to & board->bb_white_pawn) * (zobrist_keys[64 * 11 + to] + zobrist_keys[64 * 6 + to]);
-            hash ^= (move.to & board->bb_black_pawn) * (zobrist_keys[64 * 5 + to] + zobrist_keys[64 * 0 + to]);
+            hash ^= ((move.to & board->bb_white_pawn) > 0) * (zobrist_keys[64 * 11 + to] ^ zobrist_keys[64 * 6 + to]);
+            hash ^= ((move.to & board->bb_black_pawn) > 0) * (zobrist_keys[64 * 5 + to] ^ zobrist_keys[64 * 0 + to]);
             break;
         case QUEEN:
             board->bb_white_queen |= (move.to & board->bb_white_pawn);
             board->bb_black_queen |= (move.to & board->bb_black_pawn);
-            hash ^= (move.to & board->bb_white_pawn) * (zobrist_keys[64 * 9 + to] + zobrist_keys[64 * 6 + to]);
-            hash ^= (move.to & board->bb_black_pawn) * (zobrist_keys[64 * 3 + to] + zobrist_keys[64 * 0 + to]);
+            hash ^= ((move.to & board->bb_white_pawn) > 0) * (zobrist_keys[64 * 9 + to] ^ zobrist_keys[64 * 6 + to]);
+            hash ^= ((move.to & board->bb_black_pawn) > 0) * (zobrist_keys[64 * 3 + to] ^ zobrist_keys[64 * 0 + to]);
             break;
         }
         board->bb_white_pawn &= ~move.to;
         board->bb_black_pawn &= ~move.to;
     }
+    if (board->en_passant_target)
+        hash ^= zobrist_keys[773 + highest_bit(board->en_passant_target) % 8]; // xor in the new en passant hash
     if (!board->whiteToMove)
     {
         board->fullmoves++;
@@ -843,42 +1187,86 @@ static void make_move(Board *board, Move move)
 // Restores the previous board state for [board] if it exists.
 static void undo_move(Board *board)
 {
-    if (board->last_board == NULL)
+    UndoState undo;
+    uint64_t hash;
+    if (!pop_history(board, &undo, &hash))
         return; // no moves to undo
-    // get the previous board
-    Board *restore = board->last_board;
-    set_board_from(board, restore);
-    // set the new "previous board" to the previous "previous board"
-    board->last_board = restore->last_board;
-    if (board->last_board)
-        board->last_board->refcount++; // we've added a reference to it! needed or it may be lost on the free call below
-    // copy other data not copied by set_board_from
-    board->can_castle_bk = restore->can_castle_bk;
-    board->can_castle_bq = restore->can_castle_bq;
-    board->can_castle_wk = restore->can_castle_wk;
-    board->can_castle_wq = restore->can_castle_wq;
-    board->halfmoves = restore->halfmoves;
-    board->fullmoves = restore->fullmoves;
-    board->whiteToMove = restore->whiteToMove;
-    board->en_passant_target = restore->en_passant_target;
-    board->hash = restore->hash;
-    // free old move caches before overwriting
-    if (board->bb_white_moves != NULL)
-    {
-        free(board->bb_white_moves);
-    }
-    if (board->bb_black_moves != NULL)
-    {
-        free(board->bb_black_moves);
-    }
-    board->bb_white_moves = restore->bb_white_moves;
-    board->bb_black_moves = restore->bb_black_moves;
-    // ensure these are NULL before freeing the board to avoid the reused arrays being freed
-    restore->bb_white_moves = NULL;
-    restore->bb_black_moves = NULL;
-    // restore->last_board = NULL;
-    // free the restored board
-    free_board(restore);
+    Move move = undo.move;
+    if (move.castle)
+    {
+        // castling only moves pieces if there was a king to move, see make_move()
+        if (undo.moved == 10)
+        {
+            board->bb_white_king ^= move.to > move.from ? 80ull : 20ull;
+            board->bb_white_rook ^= move.to > move.from ? 160ull : 9ull;
+        }
+        else if (undo.moved == 4)
+        {
+            board->bb_black_king ^= move.to > move.from ? 5764607523034234880ull : 1441151880758558720ull;
+            board->bb_black_rook ^= move.to > move.from ? 11529215046068469760ull : 648518346341351424ull;
+        }
+    }
+    else if (undo.moved >= 0)
+    {
+        // take the moved piece back, then put back what it took
+        if (undo.promoted >= 0)
+            *get_piece_bitboard(board, undo.promoted) &= ~move.to;
+        *get_piece_bitboard(board, undo.moved) |= move.from;
+        if (undo.captured >= 0)
+            *get_piece_bitboard(board, undo.captured) |= ((BitBoard)1) << undo.captured_at;
+    }
+    board->can_castle_bk = (undo.castling & 1) > 0;
+    board->can_castle_bq = (undo.castling & 2) > 0;
+    board->can_castle_wk = (undo.castling & 4) > 0;
+    board->can_castle_wq = (undo.castling & 8) > 0;
+    board->halfmoves = undo.halfmoves;
+    board->repetition_window = undo.repetition_window;
+    board->en_passant_target = undo.en_passant_target;
+    board->hash = hash;
+    if (board->whiteToMove)
+        board->fullmoves--;
+    board->whiteToMove = !board->whiteToMove;
+    board->attack_info_cached = false;
+}
+
+// Sets API->shared_board to [base], "startpos" or a FEN, followed by the space separated [moves].
+// Each turn of a game the GUI resends the last position with the new moves on the end, so when the moves extend
+// the previous ones from the same base only the new moves are played instead of replaying the whole game.
+static void uci_set_position(const char *base, const char *moves, size_t moves_len)
+{
+    size_t played = API->position_moves_len;
+    bool extends = API->shared_board != NULL && !strcmp(base, API->position_base) && played <= moves_len &&
+                   !memcmp(moves, API->position_moves, played) && (played == 0 || moves[played] == ' ' || moves[played] == '\0');
+    if (!extends)
+    {
+        if (API->shared_board != NULL)
+            free_board(API->shared_board);
+        API->shared_board = create_board();
+        // an unreadable fen from the GUI leaves us nothing sensible to play, so fall back to the start
+        if (!set_board_from_fen(API->shared_board, strcmp(base, "startpos") ? base : NULL))
+            set_board_from_fen(API->shared_board, NULL);
+        strcpy(API->position_base, base);
+        memset(&API->latest_opponent_move, 0, sizeof(Move));
+        played = 0;
+    }
+    const char *move = moves + played;
+    while (*move != '\0')
+    {
+        if (*move == ' ')
+        {
+            move++;
+            continue;
+        }
+        char movestr[8] = {0};
+        for (int i = 0; i < 7 && move[i] != ' ' && move[i] != '\0'; i++)
+            movestr[i] = move[i];
+        Move m = load_move(movestr, API->shared_board);
+        make_move(API->shared_board, m);
+        API->latest_opponent_move = m;
+        move += strcspn(move, " ");
+    }
+    memcpy(API->position_moves, moves, moves_len + 1);
+    API->position_moves_len = moves_len;
 }
 
 // Listens for and responds to UCI messages from the GUI. Updates API state as needed.
@@ -902,6 +1290,7 @@ static int uci_process(void *arg)
             {
                 printf("id name %s\n", CHESS_BOT_NAME);
                 printf("id author %s\n", BOT_AUTHOR_NAME);
+                printf("option name Threads type spin default 1 min 1 max %d\n", MAX_SEARCH_THREADS);
                 printf("uciok\n");
                 fflush(stdout);
             }
@@ -914,16 +1303,15 @@ static int uci_process(void *arg)
             {
                 // pthread_mutex_lock(&API->mutex);
                 mtx_lock(&API->mutex);
-                memset(&API->latest_opponent_move, 0, sizeof(Move));
+                char base[256] = "startpos";
                 token = strtok(NULL, " ");
-                if (!strcmp(token, "fen"))
+                if (token != NULL && !strcmp(token, "fen"))
                 {
-                    char fenstring[256];
-                    char *next_token = fenstring;
+                    char *next_token = base;
                     token = strtok(NULL, " ");
                     while (token && strcmp(token, "moves"))
                     {
-                        if (next_token > fenstring + 256)
+                        if (next_token + strlen(token) >= base + sizeof(base))
                         {
                             // pthread_exit(NULL);
                             return 1;
@@ -934,38 +1322,26 @@ static int uci_process(void *arg)
                         if (token != NULL)
                             *(next_token - 1) = ' ';
                     }
-                    if (API->shared_board != NULL)
-                        free_board(API->shared_board);
-                    API->shared_board = create_board();
-                    set_board_from_fen(API->shared_board, fenstring);
                 }
-                else if (!strcmp(token, "startpos"))
+                else if (token != NULL && !strcmp(token, "startpos"))
                 {
-                    if (API->shared_board != NULL)
-                        free_board(API->shared_board);
-                    API->shared_board = create_board();
-                    set_board_from_fen(API->shared_board, NULL);
                     token = strtok(NULL, " ");
                 }
+                // gather the moves back into one string, see uci_set_position()
+                char moves[4096];
+                size_t moves_len = 0;
                 if (token != NULL && !strcmp(token, "moves"))
                 {
-                    char *move = strtok(NULL, " ");
-                    Move m;
-                    while (move != NULL)
+                    for (token = strtok(NULL, " "); token != NULL; token = strtok(NULL, " "))
                     {
-                        m = load_move(move, API->shared_board);
-                        make_move(API->shared_board, m);
-                        /*printf("board after update:\n");
-                        char bitboard_dump[80];
-                        printf("DEBUG: pawns follow\n");
-                        dump_bitboard(API->shared_board->bb_white_pawn, bitboard_dump);
-                        printf("white: \n%s\n", bitboard_dump);
-                        dump_bitboard(API->shared_board->bb_black_pawn, bitboard_dump);
-                        printf("black: \n%s\n", bitboard_dump);*/
-                        move = strtok(NULL, " ");
+                        if (moves_len > 0)
+                            moves[moves_len++] = ' ';
+                        strcpy(moves + moves_len, token);
+                        moves_len += strlen(token);
                     }
-                    API->latest_opponent_move = m;
                 }
+                moves[moves_len] = '\0';
+                uci_set_position(base, moves, moves_len);
                 // pthread_mutex_unlock(&API->mutex);
                 mtx_unlock(&API->mutex);
             }
@@ -993,11 +1369,25 @@ static int uci_process(void *arg)
                     }
                     token = strtok(NULL, " ");
                 }
+                API->turn_started_micros = monotonic_micros();
                 semaphore_post(&API->intermission_mutex);
-                API->turn_started_time = clock();
                 // pthread_mutex_unlock(&API->mutex);
                 mtx_unlock(&API->mutex);
             }
+            else if (!strcmp(token, "setoption"))
+            {
+                // setoption name <id> value <x>, only Threads is understood
+                char *name = NULL;
+                char *value = NULL;
+                token = strtok(NULL, " ");
+                if (token != NULL && !strcmp(token, "name"))
+                    name = strtok(NULL, " ");
+                token = strtok(NULL, " ");
+                if (token != NULL && !strcmp(token, "value"))
+                    value = strtok(NULL, " ");
+                if (name != NULL && value != NULL && !strcmp(name, "Threads"))
+                    chess_set_search_threads(atoi(value));
+            }
             else if (!strcmp(token, "stop"))
             {
                 // does nothing for now
@@ -1097,14 +1487,24 @@ static uint64_t interface_get_opponent_time_millis()
     return millis;
 }
 
-static uint64_t interface_get_elapsed_time_millis()
+static uint64_t interface_get_elapsed_time_micros()
 {
     // pthread_mutex_lock(&API->mutex);
     mtx_lock(&API->mutex);
-    uint64_t millis = (clock() - API->turn_started_time) / (CLOCKS_PER_SEC / 1000);
+    uint64_t micros = monotonic_micros() - API->turn_started_micros;
     // pthread_mutex_unlock(&API->mutex);
     mtx_unlock(&API->mutex);
-    return millis;
+    return micros;
+}
+
+static uint64_t interface_get_turn_deadline_micros(uint64_t budget_millis)
+{
+    // pthread_mutex_lock(&API->mutex);
+    mtx_lock(&API->mutex);
+    uint64_t deadline = API->turn_started_micros + budget_millis * 1000;
+    // pthread_mutex_unlock(&API->mutex);
+    mtx_unlock(&API->mutex);
+    return deadline;
 }
 
 static Move interface_get_opponent_move()
@@ -1122,881 +1522,1564 @@ static bool is_white_turn(Board *board)
     return board->whiteToMove;
 }
 
-#define get_pin(dir)                                \
-    gen = my_king;                                  \
-    last_my = 0;                                    \
-    for (int i = 0; i < 7; i++)                     \
-    {                                               \
-        gen = bb_slide_##dir(gen);                  \
-        if ((gen & all_pieces) > 0 && last_my == 0) \
-        {                                           \
-            last_my = gen;                          \
-        }                                           \
-        else if ((gen & opp_attackers) > 0)         \
-        {                                           \
-            pins |= last_my;                        \
-            break;                                  \
-        }                                           \
-        else if ((gen & all_pieces) > 0)            \
-        {                                           \
-            break;                                  \
-        }                                           \
-    }
-
-static BitBoard get_pins_ns(Board *board, bool white)
-{
-    BitBoard pins = 0;
-    BitBoard white_level_pieces = board->bb_white_rook | board->bb_white_queen;
-    BitBoard black_level_pieces = board->bb_black_rook | board->bb_black_queen;
+// Returns the pieces of white if [white], otherwise of black, which attack the square [target] on [board].
+// [occupied] gives the squares considered to block sliding pieces.
+static BitBoard get_attackers(Board *board, int target, BitBoard occupied, bool white)
+{
+    BitBoard square = ((BitBoard)1) << target;
+    BitBoard pawns = white ? board->bb_white_pawn : board->bb_black_pawn;
+    BitBoard knights = white ? board->bb_white_knight : board->bb_black_knight;
+    BitBoard king = white ? board->bb_white_king : board->bb_black_king;
+    BitBoard queens = white ? board->bb_white_queen : board->bb_black_queen;
+    BitBoard orth = queens | (white ? board->bb_white_rook : board->bb_black_rook);
+    BitBoard diag = queens | (white ? board->bb_white_bishop : board->bb_black_bishop);
+    // a pawn attacks the target if a pawn of the other color on the target would attack it
+    BitBoard pawn_sources = white ? (bb_slide_se(square) | bb_slide_sw(square)) : (bb_slide_ne(square) | bb_slide_nw(square));
+    return (pawn_sources & pawns) |
+           (knight_moves[target] & knights) |
+           (king_moves[target] & king) |
+           (bb_rook_attacks(target, occupied) & orth) |
+           (bb_bishop_attacks(target, occupied) & diag);
+}
+
+// Returns all squares attacked by white's pieces if [white], otherwise by black's, given the [occupied] squares.
+static BitBoard get_attacked(Board *board, BitBoard occupied, bool white)
+{
+    BitBoard pawns = white ? board->bb_white_pawn : board->bb_black_pawn;
+    BitBoard knights = white ? board->bb_white_knight : board->bb_black_knight;
+    BitBoard king = white ? board->bb_white_king : board->bb_black_king;
+    BitBoard queens = white ? board->bb_white_queen : board->bb_black_queen;
+    BitBoard orth = queens | (white ? board->bb_white_rook : board->bb_black_rook);
+    BitBoard diag = queens | (white ? board->bb_white_bishop : board->bb_black_bishop);
+    BitBoard attacked = white ? (bb_slide_ne(pawns) | bb_slide_nw(pawns)) : (bb_slide_se(pawns) | bb_slide_sw(pawns));
+    while (knights)
+        attacked |= knight_moves[bb_pop_lsb(&knights)];
+    attacked |= bb_slider_attacks(orth, diag, ~occupied);
+    if (king)
+        attacked |= king_moves[highest_bit(king)];
+    return attacked;
+}
+
+// Computes the check and pin information for the player to move on [board].
+static void compute_attack_info(Board *board, AttackInfo *info)
+{
+    bool white = is_white_turn(board);
     BitBoard all_pieces_white = board->bb_white_bishop | board->bb_white_king | board->bb_white_knight | board->bb_white_pawn | board->bb_white_queen | board->bb_white_rook;
     BitBoard all_pieces_black = board->bb_black_bishop | board->bb_black_king | board->bb_black_knight | board->bb_black_pawn | board->bb_black_queen | board->bb_black_rook;
     BitBoard all_pieces = all_pieces_black | all_pieces_white;
     BitBoard my_pieces = white ? all_pieces_white : all_pieces_black;
-    BitBoard opp_level_pieces = white ? black_level_pieces : white_level_pieces;
-    BitBoard opp_attackers = opp_level_pieces;
     BitBoard my_king = white ? board->bb_white_king : board->bb_black_king;
-    // check for horz/vert pins
-    BitBoard gen, last_my;
-    get_pin(n)
-        get_pin(s) return pins;
+    BitBoard opp_queens = white ? board->bb_black_queen : board->bb_white_queen;
+    BitBoard opp_orth = opp_queens | (white ? board->bb_black_rook : board->bb_white_rook);
+    BitBoard opp_diag = opp_queens | (white ? board->bb_black_bishop : board->bb_white_bishop);
+    memset(info, 0, sizeof(AttackInfo));
+    // the king doesn't block attacks on squares behind it, or it could step back along a checking ray
+    info->attacked = get_attacked(board, all_pieces ^ my_king, !white);
+    info->check_mask = ~0ull;
+    if (my_king == 0)
+        return; // no king, so no checks or pins either
+    int king = highest_bit(my_king);
+    info->checkers = get_attackers(board, king, all_pieces, !white);
+    if (info->checkers & (info->checkers - 1))
+        info->check_mask = 0; // double check, only the king may move
+    else if (info->checkers)
+        info->check_mask = rays_to[king][highest_bit(info->checkers)] | info->checkers; // block or capture the checker
+    // a piece is pinned if it's the only piece between the king and an opposing slider lined up with it
+    BitBoard snipers = (bb_rook_attacks(king, 0) & opp_orth) | (bb_bishop_attacks(king, 0) & opp_diag);
+    for (; snipers; snipers &= snipers - 1)
+    {
+        int sniper = bb_lsb(snipers);
+        BitBoard ray = rays_to[king][sniper];
+        BitBoard blockers = ray & all_pieces;
+        if (blockers && (blockers & (blockers - 1)) == 0 && (blockers & my_pieces))
+        {
+            info->pinned |= blockers;
+            for (int line = 0; line < 4; line++)
+            {
+                if (blockers & (dir_rays[line][king] | dir_rays[line + 4][king]))
+                    info->pin_rays[line] |= ray | (snipers & -snipers); // the pinned piece may still take the pinner
+            }
+        }
+    }
 }
 
-static BitBoard get_pins_ew(Board *board, bool white)
+// Returns the check and pin information for the player to move on [board], computing it if the board doesn't have it cached.
+static const AttackInfo *get_attack_info(Board *board)
 {
-    BitBoard pins = 0;
-    BitBoard white_level_pieces = board->bb_white_rook | board->bb_white_queen;
-    BitBoard black_level_pieces = board->bb_black_rook | board->bb_black_queen;
-    BitBoard all_pieces_white = board->bb_white_bishop | board->bb_white_king | board->bb_white_knight | board->bb_white_pawn | board->bb_white_queen | board->bb_white_rook;
-    BitBoard all_pieces_black = board->bb_black_bishop | board->bb_black_king | board->bb_black_knight | board->bb_black_pawn | board->bb_black_queen | board->bb_black_rook;
-    BitBoard all_pieces = all_pieces_black | all_pieces_white;
-    BitBoard my_pieces = white ? all_pieces_white : all_pieces_black;
-    BitBoard opp_level_pieces = white ? black_level_pieces : white_level_pieces;
-    BitBoard opp_attackers = opp_level_pieces;
-    BitBoard my_king = white ? board->bb_white_king : board->bb_black_king;
-    // check for horz/vert pins
-    BitBoard gen, last_my;
-    get_pin(e)
-        get_pin(w) return pins;
+    if (!board->attack_info_cached)
+    {
+        compute_attack_info(board, &board->attack_info);
+        board->attack_info_cached = true;
+    }
+    return &board->attack_info;
 }
 
-static BitBoard get_pins_nesw(Board *board, bool white)
+// Returns true if the player to move is in check on [board].
+static bool in_check(Board *board)
 {
-    BitBoard pins = 0;
-    BitBoard white_diag_pieces = board->bb_white_bishop | board->bb_white_queen;
-    BitBoard black_diag_pieces = board->bb_black_bishop | board->bb_black_queen;
-    BitBoard all_pieces_white = board->bb_white_bishop | board->bb_white_king | board->bb_white_knight | board->bb_white_pawn | board->bb_white_queen | board->bb_white_rook;
-    BitBoard all_pieces_black = board->bb_black_bishop | board->bb_black_king | board->bb_black_knight | board->bb_black_pawn | board->bb_black_queen | board->bb_black_rook;
-    BitBoard all_pieces = all_pieces_black | all_pieces_white;
-    BitBoard my_pieces = white ? all_pieces_white : all_pieces_black;
-    BitBoard opp_diag_pieces = white ? black_diag_pieces : white_diag_pieces;
-    BitBoard opp_attackers = opp_diag_pieces;
-    BitBoard my_king = white ? board->bb_white_king : board->bb_black_king;
-    // check for horz/vert pins
-    BitBoard gen, last_my;
-    get_pin(ne)
-        get_pin(sw) return pins;
+    return get_attack_info(board)->checkers > 0;
 }
 
-static BitBoard get_pins_nwse(Board *board, bool white)
+// Returns true if, on [board], the pawn on [from] taking en passant leaves its king safe.
+// The captured pawn isn't on the target square, so the regular check and pin masks don't cover this.
+static bool en_passant_legal(Board *board, BitBoard from)
 {
-    BitBoard pins = 0;
-    BitBoard white_diag_pieces = board->bb_white_bishop | board->bb_white_queen;
-    BitBoard black_diag_pieces = board->bb_black_bishop | board->bb_black_queen;
+    bool white = is_white_turn(board);
+    BitBoard my_king = white ? board->bb_white_king : board->bb_black_king;
+    if (my_king == 0)
+        return true;
+    BitBoard ept = board->en_passant_target;
+    BitBoard taken = white ? bb_slide_s(ept) : bb_slide_n(ept);
     BitBoard all_pieces_white = board->bb_white_bishop | board->bb_white_king | board->bb_white_knight | board->bb_white_pawn | board->bb_white_queen | board->bb_white_rook;
     BitBoard all_pieces_black = board->bb_black_bishop | board->bb_black_king | board->bb_black_knight | board->bb_black_pawn | board->bb_black_queen | board->bb_black_rook;
-    BitBoard all_pieces = all_pieces_black | all_pieces_white;
-    BitBoard my_pieces = white ? all_pieces_white : all_pieces_black;
-    BitBoard opp_diag_pieces = white ? black_diag_pieces : white_diag_pieces;
-    BitBoard opp_attackers = opp_diag_pieces;
-    BitBoard my_king = white ? board->bb_white_king : board->bb_black_king;
-    // check for horz/vert pins
-    BitBoard gen, last_my;
-    get_pin(nw)
-        get_pin(se) return pins;
+    BitBoard occupied = ((all_pieces_black | all_pieces_white) ^ from ^ taken) | ept; // +new pawn, -taken pawn, -old pawn
+    return (get_attackers(board, highest_bit(my_king), occupied, !white) & ~taken) == 0;
 }
 
-// Returns the pseudo-legal moves on [board] for white if [white], otherwise for black.
-// Pseudo-legal moves are valid moves prior to evaluating for checks.
-// If [all_attacked], will include all squares attacked by at least one piece, instead of filtering for legal captures.
-// Squares in [exclude] are overridden and considered empty.
-// If [exclude_pawn_moves], pawn forward advances are not included (effectively making this only return attacks).
-// Caller must free move array.
-static BitBoard *get_pseudo_legal_moves(Board *board, bool white, bool all_attacked, BitBoard exclude, bool exclude_pawn_moves)
+// adds [move] to array [moves], making sure to not write over the boundaries.
+static void add_to_moves(Move *moves, size_t *len_moves, size_t maxlen_moves, Move move)
 {
-    BitBoard *dirmoves = (BitBoard *)malloc(16 * sizeof(BitBoard));
-    if ((!all_attacked) && (exclude == 0) && (!exclude_pawn_moves))
+    if (*len_moves < maxlen_moves)
     {
-        if (white && board->bb_white_moves)
-        {
-            memcpy(dirmoves, board->bb_white_moves, 16 * sizeof(BitBoard));
-            return dirmoves;
-        }
-        else if ((!white) && board->bb_black_moves)
-        {
-            memcpy(dirmoves, board->bb_black_moves, 16 * sizeof(BitBoard));
-            return dirmoves;
-        }
+        moves[*len_moves] = move;
     }
-    memset(dirmoves, 0, 16 * sizeof(BitBoard));
-    BitBoard all_pieces_white = board->bb_white_bishop | board->bb_white_king | board->bb_white_knight | board->bb_white_pawn | board->bb_white_queen | board->bb_white_rook;
-    BitBoard all_pieces_black = board->bb_black_bishop | board->bb_black_king | board->bb_black_knight | board->bb_black_pawn | board->bb_black_queen | board->bb_black_rook;
-    BitBoard all_pieces = all_pieces_black | all_pieces_white;
-    BitBoard empty = exclude | ~all_pieces;
-    BitBoard all_attacked_mask = all_attacked ? ~0ull : 0ull;
-    BitBoard exclude_pawn_move_mask = exclude_pawn_moves ? 0ull : ~0ull;
-    if (white)
-    {
-        BitBoard pawn_moves = bb_slide_n(board->bb_white_pawn) & empty & exclude_pawn_move_mask;
-        BitBoard pawn_big_moves = bb_slide_n(pawn_moves & 0x0000000000ff0000ull) & empty;
-        BitBoard pawn_attacks_ne = bb_slide_ne(board->bb_white_pawn) & (all_pieces_black | board->en_passant_target | all_attacked_mask);
-        BitBoard pawn_attacks_nw = bb_slide_nw(board->bb_white_pawn) & (all_pieces_black | board->en_passant_target | all_attacked_mask);
-        BitBoard ray_moves_n = bb_flood_n(board->bb_white_queen | board->bb_white_rook, empty, true);
-        BitBoard ray_moves_e = bb_flood_e(board->bb_white_queen | board->bb_white_rook, empty, true);
-        BitBoard ray_moves_s = bb_flood_s(board->bb_white_queen | board->bb_white_rook, empty, true);
-        BitBoard ray_moves_w = bb_flood_w(board->bb_white_queen | board->bb_white_rook, empty, true);
-        BitBoard ray_moves_ne = bb_flood_ne(board->bb_white_queen | board->bb_white_bishop, empty, true);
-        BitBoard ray_moves_nw = bb_flood_nw(board->bb_white_queen | board->bb_white_bishop, empty, true);
-        BitBoard ray_moves_se = bb_flood_se(board->bb_white_queen | board->bb_white_bishop, empty, true);
-        BitBoard ray_moves_sw = bb_flood_sw(board->bb_white_queen | board->bb_white_bishop, empty, true);
-        BitBoard king_moves_n = bb_slide_n(board->bb_white_king);
-        BitBoard king_moves_ne = bb_slide_ne(board->bb_white_king);
-        BitBoard king_moves_e = bb_slide_e(board->bb_white_king);
-        BitBoard king_moves_se = bb_slide_se(board->bb_white_king);
-        BitBoard king_moves_s = bb_slide_s(board->bb_white_king);
-        BitBoard king_moves_sw = bb_slide_sw(board->bb_white_king);
-        BitBoard king_moves_w = bb_slide_w(board->bb_white_king);
-        BitBoard king_moves_nw = bb_slide_nw(board->bb_white_king);
-        dirmoves[DIR_NNE] = bb_slide_n(bb_slide_n(bb_slide_e(board->bb_white_knight))) & (all_attacked_mask | ~all_pieces_white);
-        dirmoves[DIR_NEE] = bb_slide_n(bb_slide_e(bb_slide_e(board->bb_white_knight))) & (all_attacked_mask | ~all_pieces_white);
-        dirmoves[DIR_NNW] = bb_slide_n(bb_slide_n(bb_slide_w(board->bb_white_knight))) & (all_attacked_mask | ~all_pieces_white);
-        dirmoves[DIR_NWW] = bb_slide_n(bb_slide_w(bb_slide_w(board->bb_white_knight))) & (all_attacked_mask | ~all_pieces_white);
-        dirmoves[DIR_SSE] = bb_slide_s(bb_slide_s(bb_slide_e(board->bb_white_knight))) & (all_attacked_mask | ~all_pieces_white);
-        dirmoves[DIR_SEE] = bb_slide_s(bb_slide_e(bb_slide_e(board->bb_white_knight))) & (all_attacked_mask | ~all_pieces_white);
-        dirmoves[DIR_SSW] = bb_slide_s(bb_slide_s(bb_slide_w(board->bb_white_knight))) & (all_attacked_mask | ~all_pieces_white);
-        dirmoves[DIR_SWW] = bb_slide_s(bb_slide_w(bb_slide_w(board->bb_white_knight))) & (all_attacked_mask | ~all_pieces_white);
-        dirmoves[DIR_N] = (pawn_moves | pawn_big_moves | ray_moves_n | king_moves_n) & (all_attacked_mask | ~all_pieces_white);
-        dirmoves[DIR_NE] = (pawn_attacks_ne | ray_moves_ne | king_moves_ne) & (all_attacked_mask | ~all_pieces_white);
-        dirmoves[DIR_E] = (ray_moves_e | king_moves_e) & (all_attacked_mask | ~all_pieces_white);
-        dirmoves[DIR_SE] = (ray_moves_se | king_moves_se) & (all_attacked_mask | ~all_pieces_white);
-        dirmoves[DIR_S] = (ray_moves_s | king_moves_s) & (all_attacked_mask | ~all_pieces_white);
-        dirmoves[DIR_SW] = (ray_moves_sw | king_moves_sw) & (all_attacked_mask | ~all_pieces_white);
-        dirmoves[DIR_W] = (ray_moves_w | king_moves_w) & (all_attacked_mask | ~all_pieces_white);
-        dirmoves[DIR_NW] = (pawn_attacks_nw | ray_moves_nw | king_moves_nw) & (all_attacked_mask | ~all_pieces_white);
+    (*len_moves)++;
+}
+
+// Adds a move from [from] to each square in [targets] to array [moves].
+// Moves landing on [opp_pieces] are flagged as captures.
+static void add_moves_to_targets(Move *moves, size_t *len_moves, size_t maxlen_moves, BitBoard from, BitBoard targets, BitBoard opp_pieces)
+{
+    Move add_move;
+    memset(&add_move, 0, sizeof(add_move));
+    add_move.from = from;
+    for (; targets; targets &= targets - 1)
+    {
+        add_move.to = targets & -targets;
+        add_move.capture = (add_move.to & opp_pieces) > 0;
+        add_to_moves(moves, len_moves, maxlen_moves, add_move);
     }
-    else
+}
+
+// Same as add_moves_to_targets, but for a pawn: moves onto the last rank are added once per possible promotion,
+// and moves onto [en_passant_target] are flagged as captures.
+static void add_pawn_moves_to_targets(Move *moves, size_t *len_moves, size_t maxlen_moves, BitBoard from, BitBoard targets, BitBoard opp_pieces, BitBoard en_passant_target)
+{
+    Move add_move;
+    memset(&add_move, 0, sizeof(add_move));
+    add_move.from = from;
+    for (; targets; targets &= targets - 1)
     {
-        BitBoard pawn_moves = bb_slide_s(board->bb_black_pawn) & empty & exclude_pawn_move_mask;
-        BitBoard pawn_big_moves = bb_slide_s(pawn_moves & 0x0000ff0000000000ull) & empty;
-        BitBoard pawn_attacks_se = bb_slide_se(board->bb_black_pawn) & (all_pieces_white | board->en_passant_target | all_attacked_mask);
-        BitBoard pawn_attacks_sw = bb_slide_sw(board->bb_black_pawn) & (all_pieces_white | board->en_passant_target | all_attacked_mask);
-        BitBoard ray_moves_n = bb_flood_n(board->bb_black_queen | board->bb_black_rook, empty, true);
-        BitBoard ray_moves_e = bb_flood_e(board->bb_black_queen | board->bb_black_rook, empty, true);
-        BitBoard ray_moves_s = bb_flood_s(board->bb_black_queen | board->bb_black_rook, empty, true);
-        BitBoard ray_moves_w = bb_flood_w(board->bb_black_queen | board->bb_black_rook, empty, true);
-        BitBoard ray_moves_ne = bb_flood_ne(board->bb_black_queen | board->bb_black_bishop, empty, true);
-        BitBoard ray_moves_nw = bb_flood_nw(board->bb_black_queen | board->bb_black_bishop, empty, true);
-        BitBoard ray_moves_se = bb_flood_se(board->bb_black_queen | board->bb_black_bishop, empty, true);
-        BitBoard ray_moves_sw = bb_flood_sw(board->bb_black_queen | board->bb_black_bishop, empty, true);
-        BitBoard king_moves_n = bb_slide_n(board->bb_black_king);
-        BitBoard king_moves_ne = bb_slide_ne(board->bb_black_king);
-        BitBoard king_moves_e = bb_slide_e(board->bb_black_king);
-        BitBoard king_moves_se = bb_slide_se(board->bb_black_king);
-        BitBoard king_moves_s = bb_slide_s(board->bb_black_king);
-        BitBoard king_moves_sw = bb_slide_sw(board->bb_black_king);
-        BitBoard king_moves_w = bb_slide_w(board->bb_black_king);
-        BitBoard king_moves_nw = bb_slide_nw(board->bb_black_king);
-        dirmoves[DIR_NNE] = bb_slide_n(bb_slide_n(bb_slide_e(board->bb_black_knight))) & (all_attacked_mask | ~all_pieces_black);
-        dirmoves[DIR_NEE] = bb_slide_n(bb_slide_e(bb_slide_e(board->bb_black_knight))) & (all_attacked_mask | ~all_pieces_black);
-        dirmoves[DIR_NNW] = bb_slide_n(bb_slide_n(bb_slide_w(board->bb_black_knight))) & (all_attacked_mask | ~all_pieces_black);
-        dirmoves[DIR_NWW] = bb_slide_n(bb_slide_w(bb_slide_w(board->bb_black_knight))) & (all_attacked_mask | ~all_pieces_black);
-        dirmoves[DIR_SSE] = bb_slide_s(bb_slide_s(bb_slide_e(board->bb_black_knight))) & (all_attacked_mask | ~all_pieces_black);
-        dirmoves[DIR_SEE] = bb_slide_s(bb_slide_e(bb_slide_e(board->bb_black_knight))) & (all_attacked_mask | ~all_pieces_black);
-        dirmoves[DIR_SSW] = bb_slide_s(bb_slide_s(bb_slide_w(board->bb_black_knight))) & (all_attacked_mask | ~all_pieces_black);
-        dirmoves[DIR_SWW] = bb_slide_s(bb_slide_w(bb_slide_w(board->bb_black_knight))) & (all_attacked_mask | ~all_pieces_black);
-        dirmoves[DIR_N] = (ray_moves_n | king_moves_n) & (all_attacked_mask | ~all_pieces_black);
-        dirmoves[DIR_NE] = (ray_moves_ne | king_moves_ne) & (all_attacked_mask | ~all_pieces_black);
-        dirmoves[DIR_E] = (ray_moves_e | king_moves_e) & (all_attacked_mask | ~all_pieces_black);
-        dirmoves[DIR_SE] = (pawn_attacks_se | ray_moves_se | king_moves_se) & (all_attacked_mask | ~all_pieces_black);
-        dirmoves[DIR_S] = (pawn_moves | pawn_big_moves | ray_moves_s | king_moves_s) & (all_attacked_mask | ~all_pieces_black);
-        dirmoves[DIR_SW] = (pawn_attacks_sw | ray_moves_sw | king_moves_sw) & (all_attacked_mask | ~all_pieces_black);
-        dirmoves[DIR_W] = (ray_moves_w | king_moves_w) & (all_attacked_mask | ~all_pieces_black);
-        dirmoves[DIR_NW] = (ray_moves_nw | king_moves_nw) & (all_attacked_mask | ~all_pieces_black);
-    }
-    if ((!all_attacked) && (exclude == 0) && (!exclude_pawn_moves))
-    {
-        if (white)
+        add_move.to = targets & -targets;
+        add_move.capture = (add_move.to & (opp_pieces | en_passant_target)) > 0;
+        if ((add_move.to & 0xff000000000000ffull) > 0)
         {
-            board->bb_white_moves = (BitBoard *)malloc(16 * sizeof(BitBoard));
-            memcpy(board->bb_white_moves, dirmoves, 16 * sizeof(BitBoard));
+            // pawn promotion
+            for (char promotion = BISHOP; promotion <= QUEEN; promotion++)
+            {
+                add_move.promotion = promotion;
+                add_to_moves(moves, len_moves, maxlen_moves, add_move);
+            }
         }
         else
         {
-            board->bb_black_moves = (BitBoard *)malloc(16 * sizeof(BitBoard));
-            memcpy(board->bb_black_moves, dirmoves, 16 * sizeof(BitBoard));
+            add_move.promotion = 0;
+            add_to_moves(moves, len_moves, maxlen_moves, add_move);
         }
     }
-    return dirmoves;
 }
 
-// Returns true if the king is in check on [board]. Checks this for white if [white], otherwise checks for black.
-static bool in_check(Board *board, bool white)
+// Returns the squares the piece on [from] may move to without exposing its king, according to [info].
+static BitBoard get_pin_mask(const AttackInfo *info, BitBoard from)
 {
-    BitBoard *moves = get_pseudo_legal_moves(board, !white, true, 0, true);
-    BitBoard king_square = white ? board->bb_white_king : board->bb_black_king;
-    bool found = false;
-    for (int dir = 0; dir < 16; dir++)
+    if ((from & info->pinned) == 0)
+        return ~0ull;
+    for (int line = 0; line < 4; line++)
     {
-        if ((moves[dir] & king_square) > 0)
-        {
-            found = true;
-            break;
-        }
+        if (from & info->pin_rays[line])
+            return info->pin_rays[line];
     }
-    free(moves);
-    return found;
+    return 0;
 }
 
-// Returns the number of pieces on [board] which attack [target]. Checks this for black attackers if [defenderWhite], otherwise checks for white attackers.
-static int num_attackers(Board *board, BitBoard target, bool defenderWhite)
+// The position facts shared by the legal target helpers below, see init_move_gen().
+typedef struct
+{
+    const AttackInfo *info;
+    bool white;
+    BitBoard my_king;
+    BitBoard all_pieces;
+    BitBoard my_pieces;
+    BitBoard opp_pieces;
+    BitBoard my_pawns;
+    BitBoard my_knights;
+    BitBoard my_orth; // rooks and queens
+    BitBoard my_diag; // bishops and queens
+} MoveGen;
+
+static void init_move_gen(Board *board, MoveGen *gen)
 {
-    BitBoard *moves = get_pseudo_legal_moves(board, !defenderWhite, true, 0, true);
-    BitBoard king_square = defenderWhite ? board->bb_white_king : board->bb_black_king;
-    int count = 0;
-    for (int dir = 0; dir < 16; dir++)
+    bool white = is_white_turn(board);
+    BitBoard all_pieces_white = board->bb_white_bishop | board->bb_white_king | board->bb_white_knight | board->bb_white_pawn | board->bb_white_queen | board->bb_white_rook;
+    BitBoard all_pieces_black = board->bb_black_bishop | board->bb_black_king | board->bb_black_knight | board->bb_black_pawn | board->bb_black_queen | board->bb_black_rook;
+    BitBoard my_queens = white ? board->bb_white_queen : board->bb_black_queen;
+    gen->info = get_attack_info(board);
+    gen->white = white;
+    gen->my_king = white ? board->bb_white_king : board->bb_black_king;
+    gen->all_pieces = all_pieces_black | all_pieces_white;
+    gen->my_pieces = white ? all_pieces_white : all_pieces_black;
+    gen->opp_pieces = white ? all_pieces_black : all_pieces_white;
+    gen->my_pawns = white ? board->bb_white_pawn : board->bb_black_pawn;
+    gen->my_knights = white ? board->bb_white_knight : board->bb_black_knight;
+    gen->my_orth = my_queens | (white ? board->bb_white_rook : board->bb_black_rook);
+    gen->my_diag = my_queens | (white ? board->bb_white_bishop : board->bb_black_bishop);
+}
+
+// Returns the squares the king may step to. Doesn't include castling, see get_castle_targets().
+static BitBoard get_king_targets(const MoveGen *gen)
+{
+    return king_moves[highest_bit(gen->my_king)] & ~gen->my_pieces & ~gen->info->attacked;
+}
+
+// Returns the squares the pawn on [from] may legally move to, including en passant.
+// When in check, non-king moves must take the checking piece or block it. In double check the mask is empty.
+static BitBoard get_pawn_targets(Board *board, const MoveGen *gen, BitBoard from)
+{
+    BitBoard empty = ~gen->all_pieces;
+    BitBoard pawn_home = gen->white ? 0x000000000000ff00ull : 0x00ff000000000000ull;
+    BitBoard push = (gen->white ? bb_slide_n(from) : bb_slide_s(from)) & empty;
+    BitBoard big_push = (gen->white ? bb_slide_n(push & bb_slide_n(pawn_home)) : bb_slide_s(push & bb_slide_s(pawn_home))) & empty;
+    BitBoard attacks = gen->white ? (bb_slide_ne(from) | bb_slide_nw(from)) : (bb_slide_se(from) | bb_slide_sw(from));
+    BitBoard targets = ((push | big_push | (attacks & gen->opp_pieces)) & gen->info->check_mask & get_pin_mask(gen->info, from));
+    if ((attacks & board->en_passant_target) > 0 && en_passant_legal(board, from))
+        targets |= board->en_passant_target;
+    return targets;
+}
+
+// Returns the squares the knight on [from] may legally move to.
+// NOTE: a knight can never perform a vertical or diagonal move
+// thus it can never move while pinned, period
+static BitBoard get_knight_targets(const MoveGen *gen, BitBoard from)
+{
+    if (from & gen->info->pinned)
+        return 0;
+    return knight_moves[highest_bit(from)] & ~gen->my_pieces & gen->info->check_mask;
+}
+
+// Returns the squares the piece on [from] may legally move to along its diagonals, or its ranks and files if [orth].
+static BitBoard get_slider_targets(const MoveGen *gen, BitBoard from, bool orth)
+{
+    int square = highest_bit(from);
+    BitBoard attacks = orth ? bb_rook_attacks(square, gen->all_pieces) : bb_bishop_attacks(square, gen->all_pieces);
+    return attacks & ~gen->my_pieces & gen->info->check_mask & get_pin_mask(gen->info, from);
+}
+
+// Returns the squares the king may castle to.
+static BitBoard get_castle_targets(Board *board, const MoveGen *gen)
+{
+    BitBoard all_opp_attacked = gen->info->attacked;
+    BitBoard all_pieces = gen->all_pieces;
+    BitBoard targets = 0;
+    if (gen->white && board->can_castle_wk && ((all_opp_attacked & 0x0000000000000070) == 0) && ((all_pieces & 0x0000000000000060) == 0))
+        targets |= bb_slide_e(bb_slide_e(gen->my_king)); // white kingside
+    if (gen->white && board->can_castle_wq && ((all_opp_attacked & 0x000000000000001c) == 0) && ((all_pieces & 0x000000000000000e) == 0))
+        targets |= bb_slide_w(bb_slide_w(gen->my_king)); // white queenside
+    if ((!gen->white) && board->can_castle_bk && ((all_opp_attacked & 0x7000000000000000) == 0) && ((all_pieces & 0x6000000000000000) == 0))
+        targets |= bb_slide_e(bb_slide_e(gen->my_king)); // black kingside
+    if ((!gen->white) && board->can_castle_bq && ((all_opp_attacked & 0x1c00000000000000) == 0) && ((all_pieces & 0x0e00000000000000) == 0))
+        targets |= bb_slide_w(bb_slide_w(gen->my_king)); // black queenside
+    return targets;
+}
+
+// Which of the legal moves generate_moves() lists.
+typedef enum
+{
+    GEN_ALL,
+    GEN_CAPTURES, // captures, en passant and promotions
+    GEN_QUIETS,   // every other move, castling included
+} GenKind;
+
+// Returns the fully legal moves of [kind] on [board].
+// The two partial kinds split the legal moves between them, so listing both gives every legal move once.
+static int generate_moves(Board *board, Move *moves, size_t maxlen_moves, GenKind kind)
+{
+    MoveGen gen;
+    init_move_gen(board, &gen);
+    size_t len_moves = 0;
+    if (gen.my_king == 0)
+        return 0; // no king, nothing sensible to generate
+    // the squares each kind may land on, pawns promote or take en passant on empty squares as well
+    BitBoard last_ranks = 0xff000000000000ffull;
+    BitBoard mask = kind == GEN_CAPTURES ? gen.opp_pieces : kind == GEN_QUIETS ? ~gen.all_pieces : ~0ull;
+    BitBoard pawn_mask = kind == GEN_CAPTURES ? (gen.opp_pieces | board->en_passant_target | last_ranks) : kind == GEN_QUIETS ? (~gen.all_pieces & ~board->en_passant_target & ~last_ranks) : ~0ull;
+    add_moves_to_targets(moves, &len_moves, maxlen_moves, gen.my_king, get_king_targets(&gen) & mask, gen.opp_pieces);
+    if (gen.info->check_mask == 0)
+        return (int)len_moves; // double check, only the king may move
+    // pawn moves, one pawn at a time since each may be pinned differently
+    for (BitBoard pieces = gen.my_pawns; pieces; pieces &= pieces - 1)
     {
-        if ((moves[dir] & king_square) > 0)
-            count++;
+        BitBoard from = pieces & -pieces;
+        add_pawn_moves_to_targets(moves, &len_moves, maxlen_moves, from, get_pawn_targets(board, &gen, from) & pawn_mask, gen.opp_pieces, board->en_passant_target);
     }
-    free(moves);
-    return count;
+    for (BitBoard pieces = gen.my_knights; pieces; pieces &= pieces - 1)
+    {
+        BitBoard from = pieces & -pieces;
+        add_moves_to_targets(moves, &len_moves, maxlen_moves, from, get_knight_targets(&gen, from) & mask, gen.opp_pieces);
+    }
+    // sliding pieces, queens are handled in both loops
+    for (BitBoard pieces = gen.my_diag; pieces; pieces &= pieces - 1)
+    {
+        BitBoard from = pieces & -pieces;
+        add_moves_to_targets(moves, &len_moves, maxlen_moves, from, get_slider_targets(&gen, from, false) & mask, gen.opp_pieces);
+    }
+    for (BitBoard pieces = gen.my_orth; pieces; pieces &= pieces - 1)
+    {
+        BitBoard from = pieces & -pieces;
+        add_moves_to_targets(moves, &len_moves, maxlen_moves, from, get_slider_targets(&gen, from, true) & mask, gen.opp_pieces);
+    }
+    if (kind == GEN_CAPTURES)
+        return (int)len_moves;
+    // castling moves
+    Move add_move;
+    memset(&add_move, 0, sizeof(add_move));
+    add_move.castle = true;
+    add_move.from = gen.my_king;
+    for (BitBoard targets = get_castle_targets(board, &gen); targets; targets &= targets - 1)
+    {
+        add_move.to = targets & -targets;
+        add_to_moves(moves, &len_moves, maxlen_moves, add_move);
+    }
+
+    return (int)len_moves;
 }
 
-// Returns valid positions from which an En Passant move can be performed on [board] by white if [white], otherwise by black
-static BitBoard en_passant_valid(Board *board, bool white)
+// Returns the fully legal moves on [board].
+static int get_legal_moves_inplace(Board *board, Move *moves, size_t maxlen_moves)
 {
-    BitBoard all_horz_white = board->bb_white_queen | board->bb_white_rook;
-    BitBoard all_horz_black = board->bb_black_queen | board->bb_black_rook;
-    BitBoard all_pieces_white = board->bb_white_bishop | board->bb_white_king | board->bb_white_knight | board->bb_white_pawn | all_horz_white;
-    BitBoard all_pieces_black = board->bb_black_bishop | board->bb_black_king | board->bb_black_knight | board->bb_black_pawn | all_horz_black;
-    BitBoard all_pieces = all_pieces_black | all_pieces_white;
-    BitBoard my_pawns = white ? board->bb_white_pawn : board->bb_black_pawn;
-    BitBoard king_square = white ? board->bb_white_king : board->bb_black_king;
-    BitBoard ept = board->en_passant_target;
-    BitBoard taken = white ? bb_slide_s(ept) : bb_slide_n(ept);
-    BitBoard valid = (bb_slide_e(taken) | bb_slide_w(taken)) & my_pawns;
-    bool one_ept_source = (valid & (valid - 1)) == 0;
-    if (!one_ept_source)
-        return valid;                                                                    // two en-passant available pawns, at least one will remain to block xrays, legal
-    BitBoard empty = ~(all_pieces ^ (ept | taken | valid));                              // +new pawn, -taken pawn, -old pawn
-    BitBoard xray = bb_blocker_e(king_square, empty) | bb_blocker_w(king_square, empty); // only possible to reveal horizontal xray
-    if (xray & (white ? all_horz_black : all_horz_white))
-        return 0; // xray on en passant rank, not legal
-    return valid; // no xray on en passant rank, legal
-}
-
-// Returns squares on [board] which, if in single check, moving to would eliminate the check against white's king if [defenderWhite], black otherwise.
-// Only valid if single check situation
-static BitBoard single_check_block_tiles(Board *board, bool defenderWhite)
-{
-    BitBoard *moves = get_pseudo_legal_moves(board, !defenderWhite, true, 0, true);
-    BitBoard all_pieces_white = board->bb_white_bishop | board->bb_white_king | board->bb_white_knight | board->bb_white_pawn | board->bb_white_queen | board->bb_white_rook;
-    BitBoard all_pieces_black = board->bb_black_bishop | board->bb_black_king | board->bb_black_knight | board->bb_black_pawn | board->bb_black_queen | board->bb_black_rook;
-    BitBoard all_pieces = all_pieces_black | all_pieces_white;
-    BitBoard king_square = defenderWhite ? board->bb_white_king : board->bb_black_king;
-    BitBoard (*flood[])(BitBoard board, BitBoard empty, bool captures) = {&bb_flood_n, &bb_flood_ne, &bb_flood_e, &bb_flood_se, &bb_flood_s, &bb_flood_sw, &bb_flood_w, &bb_flood_nw};
-    for (int dir = 0; dir < 8; dir++)
+    return generate_moves(board, moves, maxlen_moves, GEN_ALL);
+}
+
+// Returns true if [move] on [board] moves a piece of the player to move the way it moves, with the flags the generator
+// would give it, without listing any moves. If [legal], it must not leave the king in check either.
+// Anything at all is rejected safely, such as a move from a hash collision.
+static bool validate_move(Board *board, Move move, bool legal)
+{
+    MoveGen gen;
+    init_move_gen(board, &gen);
+    if (gen.my_king == 0 || (move.from & gen.my_pieces) == 0 || (move.from & (move.from - 1)) || move.to == 0 || (move.to & (move.to - 1)))
+        return false;
+    PieceType piece = chess_get_piece_from_bitboard(board, move.from);
+    if (move.castle)
+        return piece == KING && !move.capture && !move.promotion && (move.to & get_castle_targets(board, &gen)) > 0;
+    int square = highest_bit(move.from);
+    BitBoard targets;
+    switch (piece)
     {
-        if ((moves[dir] & king_square) > 0)
+    case KING:
+        targets = legal ? get_king_targets(&gen) : king_moves[square] & ~gen.my_pieces;
+        break;
+    case PAWN:
+        if (legal)
         {
-            // printf("check is from dir %d\n", dir);
-            free(moves);
-            return (*flood[(dir + 4) % 8])(king_square, ~all_pieces, true);
+            targets = get_pawn_targets(board, &gen, move.from);
         }
-    }
-    // if we didn't find it, it's a knight
-    for (int dir = 8; dir < 16; dir++)
-    {
-        if ((moves[dir] & king_square) > 0)
+        else
         {
-            free(moves);
-            switch (dir)
-            {
-            case DIR_NNE:
-                return bb_slide_s(bb_slide_s(bb_slide_w(king_square)));
-                break;
-            case DIR_NEE:
-                return bb_slide_s(bb_slide_w(bb_slide_w(king_square)));
-                break;
-            case DIR_NNW:
-                return bb_slide_s(bb_slide_s(bb_slide_e(king_square)));
-                break;
-            case DIR_NWW:
-                return bb_slide_s(bb_slide_e(bb_slide_e(king_square)));
-                break;
-            case DIR_SSE:
-                return bb_slide_n(bb_slide_n(bb_slide_w(king_square)));
-                break;
-            case DIR_SEE:
-                return bb_slide_n(bb_slide_w(bb_slide_w(king_square)));
-                break;
-            case DIR_SSW:
-                return bb_slide_n(bb_slide_n(bb_slide_e(king_square)));
-                break;
-            case DIR_SWW:
-                return bb_slide_n(bb_slide_e(bb_slide_e(king_square)));
-                break;
-            }
+            BitBoard empty = ~gen.all_pieces;
+            BitBoard pawn_home = gen.white ? 0x000000000000ff00ull : 0x00ff000000000000ull;
+            BitBoard push = (gen.white ? bb_slide_n(move.from) : bb_slide_s(move.from)) & empty;
+            BitBoard big_push = (gen.white ? bb_slide_n(push & bb_slide_n(pawn_home)) : bb_slide_s(push & bb_slide_s(pawn_home))) & empty;
+            BitBoard attacks = gen.white ? (bb_slide_ne(move.from) | bb_slide_nw(move.from)) : (bb_slide_se(move.from) | bb_slide_sw(move.from));
+            targets = push | big_push | (attacks & (gen.opp_pieces | board->en_passant_target));
         }
+        break;
+    case KNIGHT:
+        targets = legal ? get_knight_targets(&gen, move.from) : knight_moves[square] & ~gen.my_pieces;
+        break;
+    case BISHOP:
+        targets = legal ? get_slider_targets(&gen, move.from, false) : bb_bishop_attacks(square, gen.all_pieces) & ~gen.my_pieces;
+        break;
+    case ROOK:
+        targets = legal ? get_slider_targets(&gen, move.from, true) : bb_rook_attacks(square, gen.all_pieces) & ~gen.my_pieces;
+        break;
+    default:
+        targets = legal ? get_slider_targets(&gen, move.from, false) | get_slider_targets(&gen, move.from, true)
+                        : (bb_bishop_attacks(square, gen.all_pieces) | bb_rook_attacks(square, gen.all_pieces)) & ~gen.my_pieces;
+        break;
+    }
+    if (legal && piece != KING && gen.info->check_mask == 0)
+        return false; // double check, only the king may move
+    if ((move.to & targets) == 0)
+        return false;
+    BitBoard captured = gen.opp_pieces | (piece == PAWN ? board->en_passant_target : 0);
+    if (move.capture != ((move.to & captured) > 0))
+        return false;
+    if (piece == PAWN && (move.to & 0xff000000000000ffull))
+        return move.promotion >= BISHOP && move.promotion <= QUEEN;
+    return move.promotion == 0;
+}
+
+// Returns true if [move] is one of the legal moves on [board], flags included, see validate_move().
+static bool move_is_legal(Board *board, Move move)
+{
+    return validate_move(board, move, true);
+}
+
+// Returns the number of legal moves on [board], without listing them.
+static int count_legal_moves(Board *board)
+{
+    MoveGen gen;
+    init_move_gen(board, &gen);
+    if (gen.my_king == 0)
+        return 0;
+    int count = bb_popcount(get_king_targets(&gen));
+    if (gen.info->check_mask == 0)
+        return count;
+    for (BitBoard pieces = gen.my_pawns; pieces; pieces &= pieces - 1)
+    {
+        BitBoard targets = get_pawn_targets(board, &gen, pieces & -pieces);
+        count += bb_popcount(targets) + 3 * bb_popcount(targets & 0xff000000000000ffull); // 4 promotions each
+    }
+    for (BitBoard pieces = gen.my_knights; pieces; pieces &= pieces - 1)
+        count += bb_popcount(get_knight_targets(&gen, pieces & -pieces));
+    for (BitBoard pieces = gen.my_diag; pieces; pieces &= pieces - 1)
+        count += bb_popcount(get_slider_targets(&gen, pieces & -pieces, false));
+    for (BitBoard pieces = gen.my_orth; pieces; pieces &= pieces - 1)
+        count += bb_popcount(get_slider_targets(&gen, pieces & -pieces, true));
+    return count + bb_popcount(get_castle_targets(board, &gen));
+}
+
+// Returns true if there is at least one legal move on [board]. Stops at the first one found.
+static bool has_legal_moves(Board *board)
+{
+    MoveGen gen;
+    init_move_gen(board, &gen);
+    if (gen.my_king == 0)
+        return false;
+    // the king is the piece most likely to have a move when the answer is in doubt, so try it first
+    if (get_king_targets(&gen))
+        return true;
+    if (gen.info->check_mask == 0)
+        return false;
+    for (BitBoard pieces = gen.my_knights; pieces; pieces &= pieces - 1)
+    {
+        if (get_knight_targets(&gen, pieces & -pieces))
+            return true;
+    }
+    for (BitBoard pieces = gen.my_diag; pieces; pieces &= pieces - 1)
+    {
+        if (get_slider_targets(&gen, pieces & -pieces, false))
+            return true;
+    }
+    for (BitBoard pieces = gen.my_orth; pieces; pieces &= pieces - 1)
+    {
+        if (get_slider_targets(&gen, pieces & -pieces, true))
+            return true;
     }
+    for (BitBoard pieces = gen.my_pawns; pieces; pieces &= pieces - 1)
+    {
+        if (get_pawn_targets(board, &gen, pieces & -pieces))
+            return true;
+    }
+    // castling needs the square next to the king empty and safe, so the king could have stepped there instead
+    return false;
+}
+
+// Returns the number of leaf positions [depth] moves deep from [board]. The last ply is counted, not played.
+static uint64_t perft(Board *board, int depth)
+{
+    if (depth <= 0)
+        return 1;
+    if (depth == 1)
+        return (uint64_t)count_legal_moves(board);
+    Move moves[MAX_LEGAL_MOVES];
+    int len_moves = get_legal_moves_inplace(board, moves, MAX_LEGAL_MOVES);
+    uint64_t nodes = 0;
+    for (int i = 0; i < len_moves; i++)
+    {
+        make_move(board, moves[i]);
+        nodes += perft(board, depth - 1);
+        undo_move(board);
+    }
+    return nodes;
+}
+
+static atomic_int perft_threads = 1;
+
+// The root moves of a perft_divide() call, handed out to the worker threads one at a time.
+typedef struct
+{
+    Board *root; // only read while the workers run
+    int depth;
+    const Move *moves;
+    uint64_t *counts;
+    int len_moves;
+    atomic_int next_move;
+} PerftJob;
+
+static int perft_worker(void *arg)
+{
+    PerftJob *job = (PerftJob *)arg;
+    Board board;
+    copy_board(&board, job->root);
+    int i;
+    while ((i = atomic_fetch_add(&job->next_move, 1)) < job->len_moves)
+    {
+        make_move(&board, job->moves[i]);
+        job->counts[i] = perft(&board, job->depth - 1);
+        undo_move(&board);
+    }
+    release_history(board.history);
     return 0;
 }
 
-// adds [move] to array [moves], making sure to not write over the boundaries.
-static void add_to_moves(Move *moves, size_t *len_moves, size_t maxlen_moves, Move move)
+// Runs perft for each legal move on [board], splitting the moves over the perft threads.
+// Writes up to [maxlen_moves] moves and their counts to [moves] and [counts], and returns the number of legal moves.
+static int perft_divide(Board *board, int depth, Move *moves, uint64_t *counts, size_t maxlen_moves)
+{
+    if (depth <= 0)
+        return 0;
+    Move root_moves[MAX_LEGAL_MOVES];
+    uint64_t root_counts[MAX_LEGAL_MOVES];
+    PerftJob job;
+    job.root = board;
+    job.depth = depth;
+    job.moves = root_moves;
+    job.counts = root_counts;
+    job.len_moves = get_legal_moves_inplace(board, root_moves, MAX_LEGAL_MOVES); // also fills the attack cache before the workers copy it
+    atomic_init(&job.next_move, 0);
+    int num_threads = atomic_load(&perft_threads);
+    if (num_threads > job.len_moves)
+        num_threads = job.len_moves;
+    thrd_t workers[MAX_PERFT_THREADS];
+    int num_workers = 0;
+    for (; num_workers < num_threads - 1; num_workers++)
+    {
+        if (thrd_create(&workers[num_workers], &perft_worker, &job) != thrd_success)
+            break; // carry on with fewer threads
+    }
+    perft_worker(&job); // this thread works too
+    for (int i = 0; i < num_workers; i++)
+        thrd_join(workers[i], NULL);
+    for (int i = 0; i < job.len_moves && (size_t)i < maxlen_moves; i++)
+    {
+        moves[i] = root_moves[i];
+        counts[i] = root_counts[i];
+    }
+    return job.len_moves;
+}
+
+// Returns a copy of the position on [board] which shares nothing with it.
+// The copy has no move history, so it can't undo past this point.
+static Board *clone_position(Board *board)
 {
-    if (*len_moves < maxlen_moves)
+    Board *new_board = alloc_board();
+    memcpy(new_board, board, sizeof(Board));
+    new_board->history = NULL;
+    new_board->history_len = 0;
+    return new_board;
+}
+
+// Packs [move] into 17 bits: from and to square, promotion, and the capture and castle flags.
+// 0 is no move, since no move goes from a1 to a1.
+static uint32_t pack_move(Move move)
+{
+    if (move.from == 0 || move.to == 0)
+        return 0;
+    return (uint32_t)highest_bit(move.from) | ((uint32_t)highest_bit(move.to) << 6) | ((uint32_t)(move.promotion & 7) << 12) |
+           ((uint32_t)move.capture << 15) | ((uint32_t)move.castle << 16);
+}
+
+static Move unpack_move(uint32_t packed)
+{
+    Move move;
+    memset(&move, 0, sizeof(Move));
+    if (packed == 0)
+        return move;
+    move.from = ((BitBoard)1) << (packed & 63);
+    move.to = ((BitBoard)1) << ((packed >> 6) & 63);
+    move.promotion = (packed >> 12) & 7;
+    move.capture = (packed >> 15) & 1;
+    move.castle = (packed >> 16) & 1;
+    return move;
+}
+
+// One transposition table entry. Both words are written without a lock, so [check] holds the key
+// XORed with [data]: if another thread's store tears the pair, the key no longer matches and the
+// entry reads as a miss rather than as another position's result.
+typedef struct
+{
+    _Atomic uint64_t check;
+    _Atomic uint64_t data; // packed by tt_pack()
+} TTSlot;
+
+// the slots a key may be stored in, one cache line
+typedef struct
+{
+    TTSlot slots[TT_BUCKET_SLOTS];
+} TTBucket;
+
+struct TranspositionTable
+{
+    TTBucket *buckets;
+    uint64_t mask; // number of buckets - 1, a power of two
+    atomic_int age; // bumped for each search, so entries from old searches are replaced first
+};
+
+// Packs an entry's fields: move in bits 0-16, bound in 17-18, age in 19-24, depth in 25-32 and score in 33-48.
+static uint64_t tt_pack(uint32_t move, int score, int depth, TTBound bound, int age)
+{
+    depth = depth < 0 ? 0 : depth > 255 ? 255 : depth;
+    return (uint64_t)move | ((uint64_t)bound << 17) | ((uint64_t)(age & 63) << 19) | ((uint64_t)depth << 25) | ((uint64_t)(uint16_t)(int16_t)score << 33);
+}
+
+#define TT_MOVE(data) ((uint32_t)((data) & 0x1ffff))
+#define TT_BOUND(data) ((TTBound)(((data) >> 17) & 3))
+#define TT_AGE(data) ((int)(((data) >> 19) & 63))
+#define TT_DEPTH(data) ((int)(((data) >> 25) & 255))
+#define TT_SCORE(data) ((int)(int16_t)(uint16_t)((data) >> 33))
+
+// Allocates [size] bytes aligned to [alignment], a power of two dividing [size]. Free with free_aligned().
+// MSVC has no C11 aligned_alloc, only its own pair of functions.
+static void *alloc_aligned(size_t alignment, size_t size)
+{
+#if defined(_MSC_VER)
+    return _aligned_malloc(size, alignment);
+#else
+    return aligned_alloc(alignment, size);
+#endif
+}
+
+// Frees memory from alloc_aligned().
+static void free_aligned(void *ptr)
+{
+#if defined(_MSC_VER)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+// Returns a table of at most [size_mb] megabytes, rounded down to a power of two buckets, or NULL if out of memory.
+static TranspositionTable *tt_create(size_t size_mb)
+{
+    size_t num_buckets = 1;
+    while (num_buckets * 2 * sizeof(TTBucket) <= (size_mb << 20))
+        num_buckets *= 2;
+    TranspositionTable *tt = (TranspositionTable *)malloc(sizeof(TranspositionTable));
+    if (tt == NULL)
+        return NULL;
+    // aligned to its size so that each bucket is exactly one cache line, and a probe touches only one
+    tt->buckets = (TTBucket *)alloc_aligned(sizeof(TTBucket), num_buckets * sizeof(TTBucket));
+    if (tt->buckets == NULL)
     {
-        moves[*len_moves] = move;
+        free(tt);
+        return NULL;
     }
-    (*len_moves)++;
+    memset(tt->buckets, 0, num_buckets * sizeof(TTBucket));
+    tt->mask = num_buckets - 1;
+    atomic_init(&tt->age, 0);
+    return tt;
 }
 
-// Returns the fully legal moves on [board].
-static int get_legal_moves_inplace(Board *board, Move *moves, size_t maxlen_moves)
+static void tt_free(TranspositionTable *tt)
 {
-    bool white = is_white_turn(board);
-    BitBoard my_king = white ? board->bb_white_king : board->bb_black_king;
-    BitBoard *pseudo_moves = get_pseudo_legal_moves(board, is_white_turn(board), false, 0, false);
-    BitBoard *opp_pseudo_moves = get_pseudo_legal_moves(board, !is_white_turn(board), true, my_king, true);
-    /*char bitboard_dump[80];
-    printf("DEBUG: directional attack boards follow\n");
-    for (int i = 0; i < 16; i++) {
-        dump_bitboard(pseudo_moves[i], bitboard_dump);
-        printf("dir: %d\n%s\n", i, bitboard_dump);
-    }*/
-    // check situations
-    bool check = in_check(board, white);
-    bool double_check = check && (num_attackers(board, white ? board->bb_white_king : board->bb_black_king, white) > 1);
-    // get pinned pieces
-    BitBoard pins_ns = get_pins_ns(board, white);
-    BitBoard pins_ew = get_pins_ew(board, white);
-    BitBoard pins_nesw = get_pins_nesw(board, white);
-    BitBoard pins_nwse = get_pins_nwse(board, white);
-    BitBoard pins_not_ns = pins_ew | pins_nesw | pins_nwse; // en passant...
-    BitBoard pins_all = pins_ns | pins_not_ns;
-    // map to origin pieces by ray
-    // create some useful bbs
-    BitBoard all_pieces_white = board->bb_white_bishop | board->bb_white_king | board->bb_white_knight | board->bb_white_pawn | board->bb_white_queen | board->bb_white_rook;
-    BitBoard all_pieces_black = board->bb_black_bishop | board->bb_black_king | board->bb_black_knight | board->bb_black_pawn | board->bb_black_queen | board->bb_black_rook;
-    BitBoard empty = ~(all_pieces_black | all_pieces_white);
-    BitBoard my_pieces = white ? all_pieces_white : all_pieces_black;
-    BitBoard my_pawns = white ? board->bb_white_pawn : board->bb_black_pawn;
-    BitBoard opp_pieces = white ? all_pieces_black : all_pieces_white;
-    // special considerations for checks
-    BitBoard near_my_king = 0;
-    BitBoard check_attacks = 0;
-    if (check)
-    { // when in check, this is needed to evaluate legal moves
-        near_my_king = my_king | bb_slide_e(my_king) | bb_slide_w(my_king);
-        near_my_king = (bb_slide_n(near_my_king) | bb_slide_s(near_my_king) | near_my_king) ^ my_king;
-        if (!double_check)
+    if (tt == NULL)
+        return;
+    free_aligned(tt->buckets);
+    free(tt);
+}
+
+// Empties [tt]. Not safe while other threads use the table.
+static void tt_clear(TranspositionTable *tt)
+{
+    memset(tt->buckets, 0, (tt->mask + 1) * sizeof(TTBucket));
+    atomic_store(&tt->age, 0);
+}
+
+// Marks the start of a new search, making the entries stored so far the first to be replaced.
+static void tt_new_search(TranspositionTable *tt)
+{
+    atomic_fetch_add(&tt->age, 1);
+}
+
+// Hints the CPU to start loading the bucket for [key], to be probed shortly.
+static inline void tt_prefetch(TranspositionTable *tt, uint64_t key)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(&tt->buckets[key & tt->mask]);
+#endif
+}
+
+// Looks up [key] in [tt], filling [entry] and returning true if it's found.
+static bool tt_probe(TranspositionTable *tt, uint64_t key, TTEntry *entry)
+{
+    TTSlot *slots = tt->buckets[key & tt->mask].slots;
+    for (int i = 0; i < TT_BUCKET_SLOTS; i++)
+    {
+        uint64_t data = atomic_load_explicit(&slots[i].data, memory_order_relaxed);
+        uint64_t check = atomic_load_explicit(&slots[i].check, memory_order_relaxed);
+        if ((check ^ data) == key && TT_BOUND(data) != BOUND_NONE)
         {
-            check_attacks = single_check_block_tiles(board, white);
+            entry->move = unpack_move(TT_MOVE(data));
+            entry->score = TT_SCORE(data);
+            entry->depth = TT_DEPTH(data);
+            entry->bound = TT_BOUND(data);
+            return true;
         }
     }
-    // get attacked squares
-    BitBoard all_opp_attacked = 0;
-    for (int i = 0; i < 16; i++)
+    return false;
+}
+
+// Stores a search result for [key] in [tt]. Replaces the entry for the same key if there is one,
+// otherwise the shallowest entry, counting entries from earlier searches as shallower.
+static void tt_store(TranspositionTable *tt, uint64_t key, Move move, int score, int depth, TTBound bound)
+{
+    TTSlot *slots = tt->buckets[key & tt->mask].slots;
+    int age = atomic_load_explicit(&tt->age, memory_order_relaxed) & 63;
+    uint32_t packed_move = pack_move(move);
+    TTSlot *replace = &slots[0];
+    int replace_worth = INT_MAX;
+    for (int i = 0; i < TT_BUCKET_SLOTS; i++)
     {
-        all_opp_attacked |= opp_pseudo_moves[i];
+        uint64_t data = atomic_load_explicit(&slots[i].data, memory_order_relaxed);
+        uint64_t check = atomic_load_explicit(&slots[i].check, memory_order_relaxed);
+        if (TT_BOUND(data) == BOUND_NONE)
+        {
+            replace = &slots[i];
+            break; // an empty slot is as cheap as it gets
+        }
+        if ((check ^ data) == key)
+        {
+            // keep a deeper result of this search unless the new one is exact
+            if (bound != BOUND_EXACT && TT_AGE(data) == age && depth + 2 < TT_DEPTH(data))
+                return;
+            if (packed_move == 0)
+                packed_move = TT_MOVE(data);
+            replace = &slots[i];
+            break;
+        }
+        int worth = TT_DEPTH(data) - 8 * ((age - TT_AGE(data)) & 63);
+        if (worth < replace_worth)
+        {
+            replace = &slots[i];
+            replace_worth = worth;
+        }
     }
-    /*printf("DEBUG: attacked bitboard\n");
-    char bitboard_dump2[80];
-    dump_bitboard(all_opp_attacked, bitboard_dump2);
-    printf("%s\n", bitboard_dump2);*/
-    // set up moves array
-    size_t len_moves = 0;
+    uint64_t data = tt_pack(packed_move, score, depth, bound, age);
+    atomic_store_explicit(&replace->data, data, memory_order_relaxed);
+    atomic_store_explicit(&replace->check, key ^ data, memory_order_relaxed);
+}
 
-    Move add_move;
-    memset(&add_move, 0, sizeof(add_move));
-    // check every target square, if it is attacked by a direction then find piece
-    // for all ray directions except E, W, we must also consider promotions if it is a pawn move near the board edge
-    BitBoard piecepos = 1;
-    for (int square = 0; square < 64; square++)
+// Returns how full [tt] is with entries from the current search, in parts per thousand, from a sample of the table.
+static int tt_hashfull(TranspositionTable *tt)
+{
+    int age = atomic_load(&tt->age) & 63;
+    uint64_t num_buckets = tt->mask + 1 < 250 ? tt->mask + 1 : 250;
+    uint64_t used = 0;
+    for (uint64_t i = 0; i < num_buckets; i++)
     {
-        add_move.to = piecepos;
-        add_move.castle = false;
-        if (double_check && ((piecepos & near_my_king) == 0))
-        { // only very specific moves are valid
-            piecepos <<= 1;
-            continue;
-        }
-        if (pseudo_moves[DIR_N] & piecepos)
+        for (int j = 0; j < TT_BUCKET_SLOTS; j++)
         {
-            add_move.from = bb_blocker_s(piecepos, ~my_pieces);
-            // char movestr[8];
-            // dump_move(movestr, add_move);
-            // printf("testing move: %s\n", movestr);
-            bool moving_king = (add_move.from & my_king) > 0;
-            bool moving_pawn = (my_pawns & add_move.from) > 0;
-            bool move_valid = (add_move.from & pins_ns) == 0 || ((bb_flood_n(add_move.from, empty, true) | bb_flood_s(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (add_move.from & pins_ew) == 0 || ((bb_flood_e(add_move.from, empty, true) | bb_flood_w(add_move.from, empty, true)) & piecepos) > 0;     // not moving pinned piece
-            move_valid &= (add_move.from & pins_nesw) == 0 || ((bb_flood_ne(add_move.from, empty, true) | bb_flood_sw(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (add_move.from & pins_nwse) == 0 || ((bb_flood_nw(add_move.from, empty, true) | bb_flood_se(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            // printf("valid after pin check: %s\n", move_valid ? "true" : "false");
-            move_valid &= (moving_king || !double_check); // only king moves allowed in double check
-            // printf("valid after double check check: %s\n", move_valid ? "true" : "false");
-            move_valid &= ((all_opp_attacked & piecepos) == 0 || !moving_king); // if moving king, not to attacked square
-            // printf("valid after king move attack squares check: %s\n", move_valid ? "true" : "false");
-            move_valid &= (((check_attacks & piecepos) > 0 || moving_king) || !check); // single check allows king move, taking checking piece, blocking
-            // printf("valid after single check valid move check: %s\n", move_valid ? "true" : "false");
-            if (move_valid)
-            {
-                add_move.capture = (piecepos & opp_pieces) > 0;
-                if (((piecepos & 0xff000000000000ff) > 0) && moving_pawn)
-                {
-                    // pawn promotion
-                    for (char promotion = BISHOP; promotion <= QUEEN; promotion++)
-                    {
-                        add_move.promotion = promotion;
-                        add_to_moves(moves, &len_moves, maxlen_moves, add_move);
-                    }
-                }
-                else
-                {
-                    add_move.promotion = 0;
-                    add_to_moves(moves, &len_moves, maxlen_moves, add_move);
-                }
-            }
+            uint64_t data = atomic_load_explicit(&tt->buckets[i].slots[j].data, memory_order_relaxed);
+            used += TT_BOUND(data) != BOUND_NONE && TT_AGE(data) == age;
         }
-        if (pseudo_moves[DIR_NE] & piecepos)
+    }
+    return (int)(used * 1000 / (num_buckets * TT_BUCKET_SLOTS));
+}
+
+// material values for static exchange evaluation, by PieceType.
+// the king outweighs everything else together, so an exchange never ends with it being taken.
+static const int see_piece_values[7] = {0, 100, 330, 320, 500, 900, 20000};
+
+// Returns the static exchange evaluation of [move] on [board]: the material the player to move wins or loses
+// if both sides keep capturing on the target square with their least valuable piece, and may stop whenever
+// that's better for them. Sliders behind a piece that captured join in as it leaves. Castling scores 0.
+static int see(Board *board, Move move)
+{
+    static const PieceType capture_order[6] = {PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING};
+    if (move.castle)
+        return 0;
+    int target = highest_bit(move.to);
+    BitBoard all_pieces_white = board->bb_white_bishop | board->bb_white_king | board->bb_white_knight | board->bb_white_pawn | board->bb_white_queen | board->bb_white_rook;
+    BitBoard all_pieces_black = board->bb_black_bishop | board->bb_black_king | board->bb_black_knight | board->bb_black_pawn | board->bb_black_queen | board->bb_black_rook;
+    BitBoard occupied = all_pieces_white | all_pieces_black;
+    bool white = (move.from & all_pieces_white) > 0;
+    PieceType attacker = chess_get_piece_from_bitboard(board, move.from);
+    PieceType victim = chess_get_piece_from_bitboard(board, move.to);
+    int gain[32];
+    int depth = 0;
+    gain[0] = see_piece_values[victim];
+    if (attacker == PAWN && !victim && (move.to & board->en_passant_target))
+    {
+        gain[0] = see_piece_values[PAWN];
+        occupied ^= white ? bb_slide_s(move.to) : bb_slide_n(move.to);
+    }
+    if (move.promotion)
+    {
+        gain[0] += see_piece_values[move.promotion] - see_piece_values[PAWN];
+        attacker = move.promotion;
+    }
+    BitBoard from = move.from;
+    bool side = white;
+    do
+    {
+        depth++;
+        side = !side;
+        // what the other side gains by taking the piece that just captured, should that be the end of it
+        gain[depth] = see_piece_values[attacker] - gain[depth - 1];
+        if ((-gain[depth - 1] > gain[depth] ? -gain[depth - 1] : gain[depth]) < 0)
+            break; // taking can't help the other side, whatever follows
+        occupied ^= from;
+        // scan again, so that sliders lined up behind the piece that just took are found
+        BitBoard attackers = (get_attackers(board, target, occupied, true) | get_attackers(board, target, occupied, false)) & occupied;
+        BitBoard mine = attackers & (side ? all_pieces_white : all_pieces_black);
+        from = 0;
+        for (int i = 0; i < 6 && !from; i++)
         {
-            add_move.from = bb_blocker_sw(piecepos, ~my_pieces);
-            bool moving_king = (add_move.from & my_king) > 0;
-            bool moving_pawn = (my_pawns & add_move.from) > 0;
-            bool en_passant = moving_pawn && ((board->en_passant_target & piecepos) > 0);
-            BitBoard cap_pos = en_passant ? bb_slide_s(piecepos) : piecepos;
-            bool move_valid = (add_move.from & pins_ns) == 0 || ((bb_flood_n(add_move.from, empty, true) | bb_flood_s(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (add_move.from & pins_ew) == 0 || ((bb_flood_e(add_move.from, empty, true) | bb_flood_w(add_move.from, empty, true)) & piecepos) > 0;     // not moving pinned piece
-            move_valid &= (add_move.from & pins_nesw) == 0 || ((bb_flood_ne(add_move.from, empty, true) | bb_flood_sw(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (add_move.from & pins_nwse) == 0 || ((bb_flood_nw(add_move.from, empty, true) | bb_flood_se(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (moving_king || !double_check);                                                                                                           // only king moves allowed in double check
-            move_valid &= ((all_opp_attacked & piecepos) == 0 || !moving_king);                                                                                     // if moving king, not to attacked square
-            move_valid &= (((check_attacks & ((cap_pos & ~pins_not_ns) | piecepos)) > 0 || moving_king) || !check);                                                 // single check allows king move, taking checking piece, blocking
-            move_valid &= ((!en_passant) || (add_move.from & en_passant_valid(board, white)));
-            // if (en_passant && !move_valid) printf("en passant move found, but invalid!\n");
-            if (move_valid)
-            {
-                add_move.capture = (piecepos & opp_pieces) > 0 || en_passant;
-                if (((piecepos & 0xff000000000000ff) > 0) && moving_pawn)
-                {
-                    // pawn promotion
-                    for (char promotion = BISHOP; promotion <= QUEEN; promotion++)
-                    {
-                        add_move.promotion = promotion;
-                        add_to_moves(moves, &len_moves, maxlen_moves, add_move);
-                    }
-                }
-                else
-                {
-                    add_move.promotion = 0;
-                    add_to_moves(moves, &len_moves, maxlen_moves, add_move);
-                }
-            }
+            from = mine & chess_get_bitboard(board, side ? WHITE : BLACK, capture_order[i]);
+            attacker = capture_order[i];
         }
-        if (pseudo_moves[DIR_NW] & piecepos)
+        from &= -from;
+    } while (from && depth < 31);
+    // the last gain was only a guess at a capture that isn't made
+    for (depth--; depth > 0; depth--)
+        gain[depth - 1] = -(-gain[depth - 1] > gain[depth] ? -gain[depth - 1] : gain[depth]);
+    return gain[0];
+}
+
+// Returns true if the static exchange evaluation of [move] on [board] is at least [threshold], see see().
+static bool see_ge(Board *board, Move move, int threshold)
+{
+    PieceType victim = chess_get_piece_from_bitboard(board, move.to);
+    PieceType attacker = chess_get_piece_from_bitboard(board, move.from);
+    if (move.castle || move.promotion || !victim)
+        return see(board, move) >= threshold;
+    // a capture wins at most its victim, and loses at most the piece it's made with
+    if (see_piece_values[victim] < threshold)
+        return false;
+    if (see_piece_values[victim] - see_piece_values[attacker] >= threshold)
+        return true;
+    return see(board, move) >= threshold;
+}
+
+// material values for the built in evaluation, by PieceType
+static const int default_piece_values[7] = {0, 100, 330, 320, 500, 900, 0};
+
+// piece-square bonuses for the built in evaluation, by PieceType, from white's side with a1 first.
+// black's squares are looked up mirrored, see evaluate().
+static const int8_t piece_square[7][64] = {
+    {0},
+    // pawn
+    {0, 0, 0, 0, 0, 0, 0, 0,
+     5, 10, 10, -20, -20, 10, 10, 5,
+     5, -5, -10, 0, 0, -10, -5, 5,
+     0, 0, 0, 20, 20, 0, 0, 0,
+     5, 5, 10, 25, 25, 10, 5, 5,
+     10, 10, 20, 30, 30, 20, 10, 10,
+     50, 50, 50, 50, 50, 50, 50, 50,
+     0, 0, 0, 0, 0, 0, 0, 0},
+    // bishop
+    {-20, -10, -10, -10, -10, -10, -10, -20,
+     -10, 5, 0, 0, 0, 0, 5, -10,
+     -10, 10, 10, 10, 10, 10, 10, -10,
+     -10, 0, 10, 10, 10, 10, 0, -10,
+     -10, 5, 5, 10, 10, 5, 5, -10,
+     -10, 0, 5, 10, 10, 5, 0, -10,
+     -10, 0, 0, 0, 0, 0, 0, -10,
+     -20, -10, -10, -10, -10, -10, -10, -20},
+    // knight
+    {-50, -40, -30, -30, -30, -30, -40, -50,
+     -40, -20, 0, 5, 5, 0, -20, -40,
+     -30, 5, 10, 15, 15, 10, 5, -30,
+     -30, 0, 15, 20, 20, 15, 0, -30,
+     -30, 5, 15, 20, 20, 15, 5, -30,
+     -30, 0, 10, 15, 15, 10, 0, -30,
+     -40, -20, 0, 0, 0, 0, -20, -40,
+     -50, -40, -30, -30, -30, -30, -40, -50},
+    // rook
+    {0, 0, 0, 5, 5, 0, 0, 0,
+     -5, 0, 0, 0, 0, 0, 0, -5,
+     -5, 0, 0, 0, 0, 0, 0, -5,
+     -5, 0, 0, 0, 0, 0, 0, -5,
+     -5, 0, 0, 0, 0, 0, 0, -5,
+     -5, 0, 0, 0, 0, 0, 0, -5,
+     5, 10, 10, 10, 10, 10, 10, 5,
+     0, 0, 0, 0, 0, 0, 0, 0},
+    // queen
+    {-20, -10, -10, -5, -5, -10, -10, -20,
+     -10, 0, 5, 0, 0, 0, 0, -10,
+     -10, 5, 5, 5, 5, 5, 0, -10,
+     0, 0, 5, 5, 5, 5, 0, -5,
+     -5, 0, 5, 5, 5, 5, 0, -5,
+     -10, 0, 5, 5, 5, 5, 0, -10,
+     -10, 0, 0, 0, 0, 0, 0, -10,
+     -20, -10, -10, -5, -5, -10, -10, -20},
+    // king, tucked away behind its pawns
+    {20, 30, 10, 0, 0, 10, 30, 20,
+     20, 20, 0, 0, 0, 0, 20, 20,
+     -10, -20, -20, -20, -20, -20, -20, -10,
+     -20, -30, -30, -40, -40, -30, -30, -20,
+     -30, -40, -40, -50, -50, -40, -40, -30,
+     -30, -40, -40, -50, -50, -40, -40, -30,
+     -30, -40, -40, -50, -50, -40, -40, -30,
+     -30, -40, -40, -50, -50, -40, -40, -30},
+};
+
+// Returns the built in evaluation of [board] in centipawns, from the view of the player to move.
+// Counts material by [piece_values], indexed by PieceType, plus the piece_square bonuses.
+static int evaluate(Board *board, const int *piece_values)
+{
+    BitBoard white[7] = {0, board->bb_white_pawn, board->bb_white_bishop, board->bb_white_knight, board->bb_white_rook, board->bb_white_queen, board->bb_white_king};
+    BitBoard black[7] = {0, board->bb_black_pawn, board->bb_black_bishop, board->bb_black_knight, board->bb_black_rook, board->bb_black_queen, board->bb_black_king};
+    int score = 0;
+    for (int piece = PAWN; piece <= KING; piece++)
+    {
+        score += piece_values[piece] * (bb_popcount(white[piece]) - bb_popcount(black[piece]));
+        while (white[piece])
+            score += piece_square[piece][bb_pop_lsb(&white[piece])];
+        while (black[piece])
+            score -= piece_square[piece][bb_pop_lsb(&black[piece]) ^ 56];
+    }
+    return is_white_turn(board) ? score : -score;
+}
+
+// Move ordering statistics gathered by one search thread, see chess_score_moves().
+struct MoveOrdering
+{
+    Move killers[MAX_SEARCH_PLY][2]; // quiet moves that caused a beta cutoff, by ply
+    int history[2][64][64];           // how well quiet moves did, by side to move, from square and to square
+};
+
+// State for one chess_search() call, see search().
+typedef struct
+{
+    Board *board;
+    EvalFunction eval; // NULL for evaluate()
+    void *eval_data;
+    TranspositionTable *tt; // NULL for none
+    int piece_values[7];
+    uint64_t max_nodes; // 0 for no limit
+    uint64_t deadline;  // in monotonic_micros() time, 0 for no limit
+    uint64_t nodes;
+    bool stopped;
+    atomic_bool *shared_stop; // set when a Lazy SMP helper should stop, NULL for the main search
+    int depth_skew;           // extra depth this thread searches each iteration to
+    MoveOrdering ordering;
+    Move pv[MAX_SEARCH_PLY][MAX_SEARCH_PLY]; // the best line found from each ply, triangular
+    int pv_len[MAX_SEARCH_PLY];           // pv[ply] runs from ply up to pv_len[ply]
+    Move last_pv[MAX_SEARCH_PLY];         // the best line of the last completed iteration, searched first
+    int last_pv_len;
+} Search;
+
+// Returns true, and flags the search as stopped, once the node or time limit is used up.
+static bool search_should_stop(Search *search)
+{
+    if (search->stopped)
+        return true;
+    if (search->shared_stop != NULL && atomic_load_explicit(search->shared_stop, memory_order_relaxed))
+        search->stopped = true;
+    else if (search->max_nodes > 0 && search->nodes >= search->max_nodes)
+        search->stopped = true;
+    // reading the clock costs more than a node, so only look now and then
+    else if (search->deadline > 0 && (search->nodes & 1023) == 0 && monotonic_micros() >= search->deadline)
+        search->stopped = true;
+    return search->stopped;
+}
+
+static int search_eval(Search *search)
+{
+    if (search->eval != NULL)
+        return search->eval(search->board, search->eval_data);
+    return evaluate(search->board, search->piece_values);
+}
+
+static bool same_move(Move a, Move b)
+{
+    return a.from == b.from && a.to == b.to && a.promotion == b.promotion;
+}
+
+// Returns true if the position on [board] occurred [times] times before with the same player to move. Only the positions
+// since the last capture, pawn move or null move can be the same, and only every second one has the same player to move.
+// An occurrence within the last [ply] moves counts as enough on its own: within a search, the side repeating could do it again.
+static bool is_repetition(Board *board, int ply, int times)
+{
+    int count = 0;
+    int base = 0; // moves between the board and the newest move of the segment
+    int history_len = board->history_len;
+    for (History *history = board->history; history != NULL && base < board->repetition_window; history = history->parent)
+    {
+        const uint64_t *hashes = history_hashes(history);
+        // hashes[history_len - 1] is the position one move before the segment's newest
+        for (int distance = (base | 1) + 1; distance <= base + history_len && distance <= board->repetition_window; distance += 2)
         {
-            add_move.from = bb_blocker_se(piecepos, ~my_pieces);
-            bool moving_king = (add_move.from & my_king) > 0;
-            bool moving_pawn = (my_pawns & add_move.from) > 0;
-            bool en_passant = moving_pawn && ((board->en_passant_target & piecepos) > 0);
-            /*if (en_passant) {
-                char movestr[8];
-                dump_move(movestr, add_move);
-                printf("testing move: %s\n", movestr);
-            }*/
-            BitBoard cap_pos = en_passant ? bb_slide_s(piecepos) : piecepos;
-            bool move_valid = (add_move.from & pins_ns) == 0 || ((bb_flood_n(add_move.from, empty, true) | bb_flood_s(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (add_move.from & pins_ew) == 0 || ((bb_flood_e(add_move.from, empty, true) | bb_flood_w(add_move.from, empty, true)) & piecepos) > 0;     // not moving pinned piece
-            move_valid &= (add_move.from & pins_nesw) == 0 || ((bb_flood_ne(add_move.from, empty, true) | bb_flood_sw(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (add_move.from & pins_nwse) == 0 || ((bb_flood_nw(add_move.from, empty, true) | bb_flood_se(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            // if (en_passant) printf("valid after pin check: %s\n", move_valid ? "true" : "false");
-            move_valid &= (moving_king || !double_check); // only king moves allowed in double check
-            // if (en_passant) printf("valid after double check check: %s\n", move_valid ? "true" : "false");
-            move_valid &= ((all_opp_attacked & piecepos) == 0 || !moving_king); // if moving king, not to attacked square
-            // if (en_passant) printf("valid after king move attack squares check: %s\n", move_valid ? "true" : "false");
-            move_valid &= (((check_attacks & ((cap_pos & ~pins_not_ns) | piecepos)) > 0 || moving_king) || !check); // single check allows king move, taking checking piece, blocking
-            // if (en_passant) printf("valid after single check valid move check: %s\n", move_valid ? "true" : "false");
-            move_valid &= ((!en_passant) || (add_move.from & en_passant_valid(board, white)));
-            // if (en_passant) printf("valid after en passant move check: %s\n", move_valid ? "true" : "false");
-            // if (en_passant && !move_valid) printf("en passant move found, but invalid!\n");
-            if (move_valid)
-            {
-                add_move.capture = (piecepos & opp_pieces) > 0 || en_passant;
-                if (((piecepos & 0xff000000000000ff) > 0) && moving_pawn)
-                {
-                    // pawn promotion
-                    for (char promotion = BISHOP; promotion <= QUEEN; promotion++)
-                    {
-                        add_move.promotion = promotion;
-                        add_to_moves(moves, &len_moves, maxlen_moves, add_move);
-                    }
-                }
-                else
-                {
-                    add_move.promotion = 0;
-                    add_to_moves(moves, &len_moves, maxlen_moves, add_move);
-                }
-            }
+            if (hashes[history_len - (distance - base)] == board->hash && (distance <= ply || ++count >= times))
+                return true;
         }
-        if (pseudo_moves[DIR_S] & piecepos)
+        base += history_len;
+        history_len = history->parent_len;
+    }
+    return false;
+}
+
+// Returns true if the player to move has a piece other than pawns and the king.
+// Without one, zugzwang is common enough that passing can't be trusted to be the worst option.
+static bool has_non_pawn_material(Board *board)
+{
+    if (is_white_turn(board))
+        return (board->bb_white_knight | board->bb_white_bishop | board->bb_white_rook | board->bb_white_queen) > 0;
+    return (board->bb_black_knight | board->bb_black_bishop | board->bb_black_rook | board->bb_black_queen) > 0;
+}
+
+// Returns the order of [move] among the captures on [board]: most valuable victim first, then least valuable attacker.
+// A queen promotion counts as taking a queen.
+static int capture_score(Board *board, Move move)
+{
+    static const int order_value[7] = {0, 1, 3, 3, 5, 9, 20};
+    if (!move.capture)
+        return 32 * order_value[QUEEN];
+    PieceType victim = chess_get_piece_from_bitboard(board, move.to);
+    PieceType attacker = chess_get_piece_from_bitboard(board, move.from);
+    return 32 * order_value[victim ? victim : PAWN] - order_value[attacker]; // an empty target is en passant
+}
+
+// Returns the order of [move] on [board] given the statistics in [ordering], which may be NULL:
+// captures and queen promotions by capture_score(), then the killer moves for [ply], then quiet moves by history.
+static int ordering_score(const MoveOrdering *ordering, Board *board, Move move, int ply)
+{
+    int score = 0;
+    bool has_killers = ordering != NULL && ply >= 0 && ply < MAX_SEARCH_PLY;
+    if (move.capture || move.promotion == QUEEN)
+        score = (1 << 16) + capture_score(board, move);
+    else if (has_killers && same_move(move, ordering->killers[ply][0]))
+        score = (1 << 15) + 1;
+    else if (has_killers && same_move(move, ordering->killers[ply][1]))
+        score = 1 << 15;
+    else if (ordering != NULL)
+        score = ordering->history[!is_white_turn(board)][highest_bit(move.from)][highest_bit(move.to)];
+    if (move.promotion && move.promotion != QUEEN)
+        score -= 1 << 10; // underpromotions last among their kind
+    return score;
+}
+
+// Records in [ordering] that [move] on [board], [ply] plies from the root, caused a beta cutoff in a search of [depth].
+// Quiet moves become the first killer of their ply and gain history, the deeper the search the more. Captures are left alone.
+static void update_ordering(MoveOrdering *ordering, Board *board, Move move, int ply, int depth)
+{
+    if (move.capture || move.promotion)
+        return;
+    if (ply >= 0 && ply < MAX_SEARCH_PLY && !same_move(move, ordering->killers[ply][0]))
+    {
+        ordering->killers[ply][1] = ordering->killers[ply][0];
+        ordering->killers[ply][0] = move;
+    }
+    int side = !is_white_turn(board);
+    int *history = &ordering->history[side][highest_bit(move.from)][highest_bit(move.to)];
+    *history += depth * depth;
+    if (*history >= HISTORY_MAX)
+    {
+        // age everything alike, so the order between moves is kept
+        for (int from = 0; from < 64; from++)
         {
-            add_move.from = bb_blocker_n(piecepos, ~my_pieces);
-            // char movestr[8];
-            // dump_move(movestr, add_move);
-            // printf("testing move: %s\n", movestr);
-            bool moving_king = (add_move.from & my_king) > 0;
-            bool moving_pawn = (my_pawns & add_move.from) > 0;
-            bool move_valid = (add_move.from & pins_ns) == 0 || ((bb_flood_n(add_move.from, empty, true) | bb_flood_s(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (add_move.from & pins_ew) == 0 || ((bb_flood_e(add_move.from, empty, true) | bb_flood_w(add_move.from, empty, true)) & piecepos) > 0;     // not moving pinned piece
-            move_valid &= (add_move.from & pins_nesw) == 0 || ((bb_flood_ne(add_move.from, empty, true) | bb_flood_sw(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (add_move.from & pins_nwse) == 0 || ((bb_flood_nw(add_move.from, empty, true) | bb_flood_se(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            // printf("valid after pin check: %s\n", move_valid ? "true" : "false");
-            move_valid &= (moving_king || !double_check); // only king moves allowed in double check
-            // printf("valid after double check check: %s\n", move_valid ? "true" : "false");
-            move_valid &= ((all_opp_attacked & piecepos) == 0 || !moving_king); // if moving king, not to attacked square
-            // printf("valid after king move attack squares check: %s\n", move_valid ? "true" : "false");
-            move_valid &= (((check_attacks & piecepos) > 0 || moving_king) || !check); // single check allows king move, taking checking piece, blocking
-            // printf("valid after single check valid move check: %s\n", move_valid ? "true" : "false");
-            if (move_valid)
-            {
-                add_move.capture = (piecepos & opp_pieces) > 0;
-                if (((piecepos & 0xff000000000000ff) > 0) && moving_pawn)
-                {
-                    // pawn promotion
-                    for (char promotion = BISHOP; promotion <= QUEEN; promotion++)
-                    {
-                        add_move.promotion = promotion;
-                        add_to_moves(moves, &len_moves, maxlen_moves, add_move);
-                    }
-                }
-                else
-                {
-                    add_move.promotion = 0;
-                    add_to_moves(moves, &len_moves, maxlen_moves, add_move);
-                }
-            }
+            for (int to = 0; to < 64; to++)
+                ordering->history[side][from][to] /= 2;
+        }
+    }
+}
+
+// Orders [moves] for the search by writing a score for each to [scores]: the [hash_move] from the
+// transposition table first, then the move of the last best line, then as ordering_score() has it.
+static void score_moves(Search *search, Move *moves, int *scores, int len_moves, int ply, Move hash_move)
+{
+    Board *board = search->board;
+    Move pv_move;
+    memset(&pv_move, 0, sizeof(pv_move));
+    if (ply < search->last_pv_len)
+        pv_move = search->last_pv[ply];
+    for (int i = 0; i < len_moves; i++)
+    {
+        Move move = moves[i];
+        int score = 0;
+        if (same_move(move, hash_move))
+            score = 1 << 21;
+        else if (same_move(move, pv_move))
+            score = 1 << 20;
+        else
+            score = ordering_score(&search->ordering, board, move, ply);
+        scores[i] = score;
+    }
+}
+
+// Moves the best scored move from [index] onwards to [index].
+static void pick_move(Move *moves, int *scores, int len_moves, int index)
+{
+    int best = index;
+    for (int i = index + 1; i < len_moves; i++)
+    {
+        if (scores[i] > scores[best])
+            best = i;
+    }
+    Move move = moves[index];
+    moves[index] = moves[best];
+    moves[best] = move;
+    int score = scores[index];
+    scores[index] = scores[best];
+    scores[best] = score;
+}
+
+// the stages of a MovePicker, in the order they're handed out
+enum
+{
+    PICK_HASH,
+    PICK_CAPTURES_INIT,
+    PICK_CAPTURES,
+    PICK_KILLERS,
+    PICK_QUIETS_INIT,
+    PICK_QUIETS,
+    PICK_DONE,
+};
+
+static void init_move_picker(MovePicker *picker, Board *board, Move hash_move, Move killer1, Move killer2)
+{
+    picker->board = board;
+    picker->hash_move = hash_move;
+    picker->killers[0] = killer1;
+    picker->killers[1] = killer2;
+    picker->stage = PICK_HASH;
+    picker->index = 0;
+    picker->len_moves = 0;
+}
+
+// Writes the next move of [picker] to [move] and returns true, or returns false once every legal move was handed out.
+// Each stage is generated only when the one before it is used up, so a cutoff on an early move skips the rest.
+static bool next_move(MovePicker *picker, Move *move)
+{
+    Board *board = picker->board;
+    switch (picker->stage)
+    {
+    case PICK_HASH:
+        picker->stage = PICK_CAPTURES_INIT;
+        if (picker->hash_move.from && move_is_legal(board, picker->hash_move))
+        {
+            *move = picker->hash_move;
+            return true;
         }
-        if (pseudo_moves[DIR_SE] & piecepos)
+        memset(&picker->hash_move, 0, sizeof(Move)); // so it doesn't hide a generated move later on
+        // fall through
+    case PICK_CAPTURES_INIT:
+        picker->len_moves = generate_moves(board, picker->moves, MAX_LEGAL_MOVES, GEN_CAPTURES);
+        for (int i = 0; i < picker->len_moves; i++)
         {
-            add_move.from = bb_blocker_nw(piecepos, ~my_pieces);
-            bool moving_king = (add_move.from & my_king) > 0;
-            bool moving_pawn = (my_pawns & add_move.from) > 0;
-            bool en_passant = moving_pawn && ((board->en_passant_target & piecepos) > 0);
-            BitBoard cap_pos = en_passant ? bb_slide_n(piecepos) : piecepos;
-            bool move_valid = (add_move.from & pins_ns) == 0 || ((bb_flood_n(add_move.from, empty, true) | bb_flood_s(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (add_move.from & pins_ew) == 0 || ((bb_flood_e(add_move.from, empty, true) | bb_flood_w(add_move.from, empty, true)) & piecepos) > 0;     // not moving pinned piece
-            move_valid &= (add_move.from & pins_nesw) == 0 || ((bb_flood_ne(add_move.from, empty, true) | bb_flood_sw(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (add_move.from & pins_nwse) == 0 || ((bb_flood_nw(add_move.from, empty, true) | bb_flood_se(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (moving_king || !double_check);                                                                                                           // only king moves allowed in double check
-            move_valid &= ((all_opp_attacked & piecepos) == 0 || !moving_king);                                                                                     // if moving king, not to attacked square
-            move_valid &= (((check_attacks & ((cap_pos & ~pins_not_ns) | piecepos)) > 0 || moving_king) || !check);                                                 // single check allows king move, taking checking piece, blocking
-            move_valid &= ((!en_passant) || (add_move.from & en_passant_valid(board, white)));
-            // if (en_passant && !move_valid) printf("en passant move found, but invalid!\n");
-            if (move_valid)
-            {
-                add_move.capture = (piecepos & opp_pieces) > 0 || en_passant;
-                if (((piecepos & 0xff000000000000ff) > 0) && moving_pawn)
-                {
-                    // pawn promotion
-                    for (char promotion = BISHOP; promotion <= QUEEN; promotion++)
-                    {
-                        add_move.promotion = promotion;
-                        add_to_moves(moves, &len_moves, maxlen_moves, add_move);
-                    }
-                }
-                else
-                {
-                    add_move.promotion = 0;
-                    add_to_moves(moves, &len_moves, maxlen_moves, add_move);
-                }
-            }
+            Move capture = picker->moves[i];
+            picker->scores[i] = capture_score(board, capture) - (capture.promotion && capture.promotion != QUEEN ? 1024 : 0);
         }
-        if (pseudo_moves[DIR_SW] & piecepos)
+        picker->index = 0;
+        picker->stage = PICK_CAPTURES;
+        // fall through
+    case PICK_CAPTURES:
+        while (picker->index < picker->len_moves)
         {
-            add_move.from = bb_blocker_ne(piecepos, ~my_pieces);
-            bool moving_king = (add_move.from & my_king) > 0;
-            bool moving_pawn = (my_pawns & add_move.from) > 0;
-            bool en_passant = moving_pawn && ((board->en_passant_target & piecepos) > 0);
-            BitBoard cap_pos = en_passant ? bb_slide_n(piecepos) : piecepos;
-            bool move_valid = (add_move.from & pins_ns) == 0 || ((bb_flood_n(add_move.from, empty, true) | bb_flood_s(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (add_move.from & pins_ew) == 0 || ((bb_flood_e(add_move.from, empty, true) | bb_flood_w(add_move.from, empty, true)) & piecepos) > 0;     // not moving pinned piece
-            move_valid &= (add_move.from & pins_nesw) == 0 || ((bb_flood_ne(add_move.from, empty, true) | bb_flood_sw(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (add_move.from & pins_nwse) == 0 || ((bb_flood_nw(add_move.from, empty, true) | bb_flood_se(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (moving_king || !double_check);                                                                                                           // only king moves allowed in double check
-            move_valid &= ((all_opp_attacked & piecepos) == 0 || !moving_king);                                                                                     // if moving king, not to attacked square
-            move_valid &= (((check_attacks & ((cap_pos & ~pins_not_ns) | piecepos)) > 0 || moving_king) || !check);                                                 // single check allows king move, taking checking piece, blocking
-            move_valid &= ((!en_passant) || (add_move.from & en_passant_valid(board, white)));
-            // if (en_passant && !move_valid) printf("en passant move found, but invalid!\n");
-            if (move_valid)
+            pick_move(picker->moves, picker->scores, picker->len_moves, picker->index);
+            Move capture = picker->moves[picker->index++];
+            if (!same_move(capture, picker->hash_move))
             {
-                add_move.capture = (piecepos & opp_pieces) > 0 || en_passant;
-                if (((piecepos & 0xff000000000000ff) > 0) && moving_pawn)
-                {
-                    // pawn promotion
-                    for (char promotion = BISHOP; promotion <= QUEEN; promotion++)
-                    {
-                        add_move.promotion = promotion;
-                        add_to_moves(moves, &len_moves, maxlen_moves, add_move);
-                    }
-                }
-                else
-                {
-                    add_move.promotion = 0;
-                    add_to_moves(moves, &len_moves, maxlen_moves, add_move);
-                }
+                *move = capture;
+                return true;
             }
         }
-        add_move.promotion = 0;
-        if (pseudo_moves[DIR_E] & piecepos)
+        picker->index = 0;
+        picker->stage = PICK_KILLERS;
+        // fall through
+    case PICK_KILLERS:
+        while (picker->index < 2)
         {
-            add_move.from = bb_blocker_w(piecepos, ~my_pieces);
-            // char movestr[8];
-            // dump_move(movestr, add_move);
-            // printf("testing move: %s\n", movestr);
-            bool moving_king = (add_move.from & my_king) > 0;
-            bool moving_pawn = (my_pawns & add_move.from) > 0;
-            bool move_valid = (add_move.from & pins_ns) == 0 || ((bb_flood_n(add_move.from, empty, true) | bb_flood_s(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (add_move.from & pins_ew) == 0 || ((bb_flood_e(add_move.from, empty, true) | bb_flood_w(add_move.from, empty, true)) & piecepos) > 0;     // not moving pinned piece
-            move_valid &= (add_move.from & pins_nesw) == 0 || ((bb_flood_ne(add_move.from, empty, true) | bb_flood_sw(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (add_move.from & pins_nwse) == 0 || ((bb_flood_nw(add_move.from, empty, true) | bb_flood_se(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            // printf("valid after pin check: %s\n", move_valid ? "true" : "false");
-            move_valid &= (moving_king || !double_check); // only king moves allowed in double check
-            // printf("valid after double check check: %s\n", move_valid ? "true" : "false");
-            move_valid &= ((all_opp_attacked & piecepos) == 0 || !moving_king); // if moving king, not to attacked square
-            // printf("valid after king move attack squares check: %s\n", move_valid ? "true" : "false");
-            move_valid &= (((check_attacks & piecepos) > 0 || moving_king) || !check); // single check allows king move, taking checking piece, blocking
-            // printf("valid after single check valid move check: %s\n", move_valid ? "true" : "false");
-            if (move_valid)
+            Move killer = picker->killers[picker->index++];
+            // captures and promotions were handed out already, an unusable killer is dropped so the quiets don't skip it
+            if (killer.from && !killer.capture && !killer.promotion && !same_move(killer, picker->hash_move) &&
+                (picker->index == 1 || !same_move(killer, picker->killers[0])) && move_is_legal(board, killer))
             {
-                add_move.capture = (piecepos & opp_pieces) > 0;
-                add_to_moves(moves, &len_moves, maxlen_moves, add_move);
+                *move = killer;
+                return true;
             }
+            memset(&picker->killers[picker->index - 1], 0, sizeof(Move));
         }
-        if (pseudo_moves[DIR_W] & piecepos)
+        picker->stage = PICK_QUIETS_INIT;
+        // fall through
+    case PICK_QUIETS_INIT:
+        picker->len_moves = generate_moves(board, picker->moves, MAX_LEGAL_MOVES, GEN_QUIETS);
+        picker->index = 0;
+        picker->stage = PICK_QUIETS;
+        // fall through
+    case PICK_QUIETS:
+        while (picker->index < picker->len_moves)
         {
-            add_move.from = bb_blocker_e(piecepos, ~my_pieces);
-            bool moving_king = (add_move.from & my_king) > 0;
-            bool moving_pawn = (my_pawns & add_move.from) > 0;
-            bool move_valid = (add_move.from & pins_ns) == 0 || ((bb_flood_n(add_move.from, empty, true) | bb_flood_s(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (add_move.from & pins_ew) == 0 || ((bb_flood_e(add_move.from, empty, true) | bb_flood_w(add_move.from, empty, true)) & piecepos) > 0;     // not moving pinned piece
-            move_valid &= (add_move.from & pins_nesw) == 0 || ((bb_flood_ne(add_move.from, empty, true) | bb_flood_sw(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (add_move.from & pins_nwse) == 0 || ((bb_flood_nw(add_move.from, empty, true) | bb_flood_se(add_move.from, empty, true)) & piecepos) > 0; // not moving pinned piece
-            move_valid &= (moving_king || !double_check);                                                                                                           // only king moves allowed in double check
-            move_valid &= ((all_opp_attacked & piecepos) == 0 || !moving_king);                                                                                     // if moving king, not to attacked square
-            move_valid &= (((check_attacks & piecepos) > 0 || moving_king) || !check);                                                                              // single check allows king move, taking checking piece, blocking
-            if (move_valid)
+            Move quiet = picker->moves[picker->index++];
+            if (!same_move(quiet, picker->hash_move) && !same_move(quiet, picker->killers[0]) && !same_move(quiet, picker->killers[1]))
             {
-                add_move.capture = (piecepos & opp_pieces) > 0;
-                add_to_moves(moves, &len_moves, maxlen_moves, add_move);
+                *move = quiet;
+                return true;
             }
         }
-        // NOTE: a knight can never perform a vertical or diagonal move
-        // thus it can never move while pinned, period
-        // we can skip the complicated ray-bound checks and do a global pin check
-        if (pseudo_moves[DIR_NNE] & piecepos)
+        picker->stage = PICK_DONE;
+        // fall through
+    default:
+        return false;
+    }
+}
+
+// Mate scores count plies from the root, but a table entry may be reached from another root,
+// so they are stored counting from the entry's position instead.
+static int score_to_tt(int score, int ply)
+{
+    if (score >= MATE_SCORE - MAX_SEARCH_PLY)
+        return score + ply;
+    if (score <= -MATE_SCORE + MAX_SEARCH_PLY)
+        return score - ply;
+    return score;
+}
+
+static int score_from_tt(int score, int ply)
+{
+    if (score >= MATE_SCORE - MAX_SEARCH_PLY)
+        return score - ply;
+    if (score <= -MATE_SCORE + MAX_SEARCH_PLY)
+        return score + ply;
+    return score;
+}
+
+// Records [move] followed by the best line from [ply] + 1 as the best line from [ply].
+static void update_pv(Search *search, int ply, Move move)
+{
+    search->pv[ply][ply] = move;
+    for (int i = ply + 1; i < search->pv_len[ply + 1]; i++)
+        search->pv[ply][i] = search->pv[ply + 1][i];
+    search->pv_len[ply] = search->pv_len[ply + 1] > ply + 1 ? search->pv_len[ply + 1] : ply + 1;
+}
+
+// Searches captures and queen promotions until the position is quiet, so the evaluation isn't taken in the middle of an exchange.
+// When in check every evasion is searched instead.
+static int quiesce(Search *search, int alpha, int beta, int ply)
+{
+    Board *board = search->board;
+    search->pv_len[ply] = ply;
+    search->nodes++;
+    if (search_should_stop(search))
+        return 0;
+    bool check = in_check(board);
+    if (ply >= MAX_SEARCH_PLY - 1)
+        return check ? 0 : search_eval(search);
+    int best_score = -MATE_SCORE + ply;
+    if (!check)
+    {
+        // standing pat: the player to move may decline every capture
+        best_score = search_eval(search);
+        if (best_score >= beta)
+            return best_score;
+        if (best_score > alpha)
+            alpha = best_score;
+    }
+    Move moves[MAX_LEGAL_MOVES];
+    int scores[MAX_LEGAL_MOVES];
+    // out of check only captures and promotions are tried, so the quiet moves aren't generated at all
+    int len_moves = generate_moves(board, moves, MAX_LEGAL_MOVES, check ? GEN_ALL : GEN_CAPTURES);
+    if (len_moves == 0)
+        return check ? -MATE_SCORE + ply : best_score;
+    Move no_move;
+    memset(&no_move, 0, sizeof(Move));
+    score_moves(search, moves, scores, len_moves, ply, no_move);
+    for (int i = 0; i < len_moves; i++)
+    {
+        pick_move(moves, scores, len_moves, i);
+        Move move = moves[i];
+        if (!check && (move.promotion ? move.promotion != QUEEN : !move.capture))
+            continue;
+        if (!check && !move.promotion && !see_ge(board, move, 0))
+            continue; // the capture loses material even if the exchange is played out
+        make_move(board, move);
+        int score = -quiesce(search, -beta, -alpha, ply + 1);
+        undo_move(board);
+        if (search->stopped)
+            return 0;
+        if (score > best_score)
         {
-            add_move.from = bb_slide_s(bb_slide_s(bb_slide_w(piecepos)));
-            bool moving_king = (add_move.from & my_king) > 0;
-            bool moving_pawn = (my_pawns & add_move.from) > 0;
-            bool move_valid = (add_move.from & pins_all) == 0;                         // not moving pinned piece
-            move_valid &= (moving_king || !double_check);                              // only king moves allowed in double check
-            move_valid &= ((all_opp_attacked & piecepos) == 0 || !moving_king);        // if moving king, not to attacked square
-            move_valid &= (((check_attacks & piecepos) > 0 || moving_king) || !check); // single check allows king move, taking checking piece, blocking
-            if (move_valid)
+            best_score = score;
+            if (score > alpha)
             {
-                add_move.capture = (piecepos & opp_pieces) > 0;
-                add_move.promotion = 0;
-                add_to_moves(moves, &len_moves, maxlen_moves, add_move);
+                alpha = score;
+                update_pv(search, ply, move);
+                if (score >= beta)
+                    break;
             }
         }
-        if (pseudo_moves[DIR_NEE] & piecepos)
+    }
+    return best_score;
+}
+
+// Principal variation search of [depth] plies on the board, [ply] plies from the root.
+// Returns a score for the player to move which is exact if it falls between [alpha] and [beta], and a bound otherwise.
+static int search_node(Search *search, int depth, int alpha, int beta, int ply, bool allow_null)
+{
+    Board *board = search->board;
+    search->pv_len[ply] = ply;
+    if (ply > 0 && (board->halfmoves >= FIFTY_MOVE_PLIES || is_repetition(board, ply, 2)))
+        return 0;
+    if (ply >= MAX_SEARCH_PLY - 1)
+        return search_eval(search);
+    bool check = in_check(board);
+    if (check)
+        depth++; // don't let checks push threats past the horizon
+    if (depth <= 0)
+        return quiesce(search, alpha, beta, ply);
+    search->nodes++;
+    if (search_should_stop(search))
+        return 0;
+    bool pv_node = beta - alpha > 1;
+    int original_alpha = alpha;
+    Move hash_move;
+    memset(&hash_move, 0, sizeof(Move));
+    TTEntry entry;
+    if (search->tt != NULL && tt_probe(search->tt, board->hash, &entry))
+    {
+        hash_move = entry.move;
+        int score = score_from_tt(entry.score, ply);
+        // the line to a pv node is kept exact, so only cut elsewhere
+        if (!pv_node && entry.depth >= depth &&
+            (entry.bound == BOUND_EXACT || (entry.bound == BOUND_LOWER && score >= beta) || (entry.bound == BOUND_UPPER && score <= alpha)))
+            return score;
+    }
+    // null move pruning: if passing still holds beta with a reduced search, a real move surely will
+    if (allow_null && !pv_node && !check && depth >= 3 && has_non_pawn_material(board) && search_eval(search) >= beta)
+    {
+        Move null_move;
+        memset(&null_move, 0, sizeof(Move));
+        make_move(board, null_move);
+        int score = -search_node(search, depth - 1 - NULL_MOVE_REDUCTION, -beta, -beta + 1, ply + 1, false);
+        undo_move(board);
+        if (search->stopped)
+            return 0;
+        if (score >= beta)
+            return score >= MATE_SCORE - MAX_SEARCH_PLY ? beta : score; // passing can't prove a mate
+    }
+    Move moves[MAX_LEGAL_MOVES];
+    int scores[MAX_LEGAL_MOVES];
+    int len_moves = -1; // not generated yet
+    // a legal hash move is searched before generating the others, a cutoff on it saves the generation
+    bool hash_first = hash_move.from && move_is_legal(board, hash_move);
+    int best_score = -MATE_SCORE;
+    Move best_move;
+    memset(&best_move, 0, sizeof(Move));
+    for (int i = 0;; i++)
+    {
+        Move move = hash_move;
+        if (i > 0 || !hash_first)
         {
-            add_move.from = bb_slide_s(bb_slide_w(bb_slide_w(piecepos)));
-            bool moving_king = (add_move.from & my_king) > 0;
-            bool moving_pawn = (my_pawns & add_move.from) > 0;
-            bool move_valid = (add_move.from & pins_all) == 0;                         // not moving pinned piece
-            move_valid &= (moving_king || !double_check);                              // only king moves allowed in double check
-            move_valid &= ((all_opp_attacked & piecepos) == 0 || !moving_king);        // if moving king, not to attacked square
-            move_valid &= (((check_attacks & piecepos) > 0 || moving_king) || !check); // single check allows king move, taking checking piece, blocking
-            if (move_valid)
+            if (len_moves < 0)
             {
-                add_move.capture = (piecepos & opp_pieces) > 0;
-                add_move.promotion = 0;
-                add_to_moves(moves, &len_moves, maxlen_moves, add_move);
+                len_moves = get_legal_moves_inplace(board, moves, MAX_LEGAL_MOVES);
+                if (len_moves == 0)
+                    return check ? -MATE_SCORE + ply : 0;
+                score_moves(search, moves, scores, len_moves, ply, hash_move);
             }
+            int index = i - hash_first;
+            if (index >= len_moves)
+                break;
+            pick_move(moves, scores, len_moves, index);
+            move = moves[index];
+            if (hash_first && same_move(move, hash_move))
+                continue; // searched already
         }
-        if (pseudo_moves[DIR_NNW] & piecepos)
+        make_move(board, move);
+        if (search->tt != NULL)
+            tt_prefetch(search->tt, board->hash);
+        int score;
+        if (i == 0)
         {
-            add_move.from = bb_slide_s(bb_slide_s(bb_slide_e(piecepos)));
-            bool moving_king = (add_move.from & my_king) > 0;
-            bool moving_pawn = (my_pawns & add_move.from) > 0;
-            bool move_valid = (add_move.from & pins_all) == 0;                         // not moving pinned piece
-            move_valid &= (moving_king || !double_check);                              // only king moves allowed in double check
-            move_valid &= ((all_opp_attacked & piecepos) == 0 || !moving_king);        // if moving king, not to attacked square
-            move_valid &= (((check_attacks & piecepos) > 0 || moving_king) || !check); // single check allows king move, taking checking piece, blocking
-            if (move_valid)
-            {
-                add_move.capture = (piecepos & opp_pieces) > 0;
-                add_move.promotion = 0;
-                add_to_moves(moves, &len_moves, maxlen_moves, add_move);
-            }
+            score = -search_node(search, depth - 1, -beta, -alpha, ply + 1, true);
         }
-        if (pseudo_moves[DIR_NWW] & piecepos)
+        else
         {
-            add_move.from = bb_slide_s(bb_slide_e(bb_slide_e(piecepos)));
-            bool moving_king = (add_move.from & my_king) > 0;
-            bool moving_pawn = (my_pawns & add_move.from) > 0;
-            bool move_valid = (add_move.from & pins_all) == 0;                         // not moving pinned piece
-            move_valid &= (moving_king || !double_check);                              // only king moves allowed in double check
-            move_valid &= ((all_opp_attacked & piecepos) == 0 || !moving_king);        // if moving king, not to attacked square
-            move_valid &= (((check_attacks & piecepos) > 0 || moving_king) || !check); // single check allows king move, taking checking piece, blocking
-            if (move_valid)
-            {
-                add_move.capture = (piecepos & opp_pieces) > 0;
-                add_move.promotion = 0;
-                add_to_moves(moves, &len_moves, maxlen_moves, add_move);
-            }
+            // every later move is expected to be worse, which a null window search proves cheaply
+            score = -search_node(search, depth - 1, -alpha - 1, -alpha, ply + 1, true);
+            if (score > alpha && score < beta)
+                score = -search_node(search, depth - 1, -beta, -alpha, ply + 1, true);
         }
-        if (pseudo_moves[DIR_SSE] & piecepos)
+        undo_move(board);
+        if (search->stopped)
+            return 0;
+        if (score > best_score)
         {
-            add_move.from = bb_slide_n(bb_slide_n(bb_slide_w(piecepos)));
-            bool moving_king = (add_move.from & my_king) > 0;
-            bool moving_pawn = (my_pawns & add_move.from) > 0;
-            bool move_valid = (add_move.from & pins_all) == 0;                         // not moving pinned piece
-            move_valid &= (moving_king || !double_check);                              // only king moves allowed in double check
-            move_valid &= ((all_opp_attacked & piecepos) == 0 || !moving_king);        // if moving king, not to attacked square
-            move_valid &= (((check_attacks & piecepos) > 0 || moving_king) || !check); // single check allows king move, taking checking piece, blocking
-            if (move_valid)
+            best_score = score;
+            if (score > alpha)
             {
-                add_move.capture = (piecepos & opp_pieces) > 0;
-                add_move.promotion = 0;
-                add_to_moves(moves, &len_moves, maxlen_moves, add_move);
+                alpha = score;
+                best_move = move;
+                update_pv(search, ply, move);
+                if (score >= beta)
+                {
+                    update_ordering(&search->ordering, board, move, ply, depth);
+                    break;
+                }
             }
         }
-        if (pseudo_moves[DIR_SEE] & piecepos)
+    }
+    if (search->tt != NULL)
+    {
+        TTBound bound = best_score >= beta ? BOUND_LOWER : best_score > original_alpha ? BOUND_EXACT : BOUND_UPPER;
+        tt_store(search->tt, board->hash, best_move, score_to_tt(best_score, ply), depth, bound);
+    }
+    return best_score;
+}
+
+// Runs iterative deepening on [state] up to [max_depth] plies, plus the state's depth skew, until it's stopped.
+// Each finished iteration is written to [result].
+static void deepen(Search *state, int max_depth, SearchResult *result)
+{
+    int score = 0;
+    for (int depth = 1; depth <= max_depth; depth++)
+    {
+        int search_depth = depth + state->depth_skew < MAX_SEARCH_PLY - 1 ? depth + state->depth_skew : MAX_SEARCH_PLY - 1;
+        // aspiration window: expect the score near the last one, widening on each miss
+        int window = ASPIRATION_WINDOW;
+        int alpha = -MATE_SCORE;
+        int beta = MATE_SCORE;
+        if (depth >= 4)
         {
-            add_move.from = bb_slide_n(bb_slide_w(bb_slide_w(piecepos)));
-            bool moving_king = (add_move.from & my_king) > 0;
-            bool moving_pawn = (my_pawns & add_move.from) > 0;
-            bool move_valid = (add_move.from & pins_all) == 0;                         // not moving pinned piece
-            move_valid &= (moving_king || !double_check);                              // only king moves allowed in double check
-            move_valid &= ((all_opp_attacked & piecepos) == 0 || !moving_king);        // if moving king, not to attacked square
-            move_valid &= (((check_attacks & piecepos) > 0 || moving_king) || !check); // single check allows king move, taking checking piece, blocking
-            if (move_valid)
-            {
-                add_move.capture = (piecepos & opp_pieces) > 0;
-                add_move.promotion = 0;
-                add_to_moves(moves, &len_moves, maxlen_moves, add_move);
-            }
+            alpha = score - window > -MATE_SCORE ? score - window : -MATE_SCORE;
+            beta = score + window < MATE_SCORE ? score + window : MATE_SCORE;
         }
-        if (pseudo_moves[DIR_SSW] & piecepos)
+        int iteration_score;
+        while (true)
         {
-            add_move.from = bb_slide_n(bb_slide_n(bb_slide_e(piecepos)));
-            bool moving_king = (add_move.from & my_king) > 0;
-            bool moving_pawn = (my_pawns & add_move.from) > 0;
-            bool move_valid = (add_move.from & pins_all) == 0;                         // not moving pinned piece
-            move_valid &= (moving_king || !double_check);                              // only king moves allowed in double check
-            move_valid &= ((all_opp_attacked & piecepos) == 0 || !moving_king);        // if moving king, not to attacked square
-            move_valid &= (((check_attacks & piecepos) > 0 || moving_king) || !check); // single check allows king move, taking checking piece, blocking
-            if (move_valid)
-            {
-                add_move.capture = (piecepos & opp_pieces) > 0;
-                add_move.promotion = 0;
-                add_to_moves(moves, &len_moves, maxlen_moves, add_move);
-            }
+            iteration_score = search_node(state, search_depth, alpha, beta, 0, false);
+            if (state->stopped)
+                break;
+            window *= 2;
+            if (iteration_score <= alpha && alpha > -MATE_SCORE)
+                alpha = iteration_score - window > -MATE_SCORE ? iteration_score - window : -MATE_SCORE;
+            else if (iteration_score >= beta && beta < MATE_SCORE)
+                beta = iteration_score + window < MATE_SCORE ? iteration_score + window : MATE_SCORE;
+            else
+                break;
         }
-        if (pseudo_moves[DIR_SWW] & piecepos)
+        if (state->stopped)
+            break; // a cut short iteration can't be trusted, keep the last one
+        score = iteration_score;
+        result->depth = search_depth;
+        result->score = score;
+        state->last_pv_len = state->pv_len[0];
+        memcpy(state->last_pv, state->pv[0], state->last_pv_len * sizeof(Move));
+        if (state->last_pv_len > 0)
         {
-            add_move.from = bb_slide_n(bb_slide_e(bb_slide_e(piecepos)));
-            bool moving_king = (add_move.from & my_king) > 0;
-            bool moving_pawn = (my_pawns & add_move.from) > 0;
-            bool move_valid = (add_move.from & pins_all) == 0;                         // not moving pinned piece
-            move_valid &= (moving_king || !double_check);                              // only king moves allowed in double check
-            move_valid &= ((all_opp_attacked & piecepos) == 0 || !moving_king);        // if moving king, not to attacked square
-            move_valid &= (((check_attacks & piecepos) > 0 || moving_king) || !check); // single check allows king move, taking checking piece, blocking
-            if (move_valid)
-            {
-                add_move.capture = (piecepos & opp_pieces) > 0;
-                add_move.promotion = 0;
-                add_to_moves(moves, &len_moves, maxlen_moves, add_move);
-            }
+            result->best_move = state->last_pv[0];
+            result->pv_len = state->last_pv_len;
+            memcpy(result->pv, state->last_pv, result->pv_len * sizeof(Move));
         }
-        piecepos <<= 1;
-    }
-    BitBoard all_pieces = all_pieces_black | all_pieces_white;
-    // castling moves
-    /*char dumpboard[80];
-    dump_bitboard(all_opp_attacked, dumpboard);
-    printf("Opponent attacked:\n%s\n", dumpboard);
-    printf("pieces clear (White kingside): %d\n", ((all_pieces & 0x0000000000000060) == 0));
-    printf("path safe (White kingside): %d\n", ((all_opp_attacked & 0x000000000000001e) == 0));
-    printf("castle rights (White kingside): %d\n", white && board->can_castle_wk);
-    printf("pieces clear (White queenside): %d\n", ((all_pieces & 0x000000000000000e) == 0));
-    printf("path safe (White queenside): %d\n", ((all_opp_attacked & 0x0000000000000070) == 0));
-    printf("castle rights (White queenside): %d\n", white && board->can_castle_wq);
-    printf("pieces clear (Black kingside): %d\n", ((all_pieces & 0x6000000000000000) == 0));
-    printf("path safe (Black kingside): %d\n", ((all_opp_attacked & 0x1e00000000000000) == 0));
-    printf("castle rights (Black kingside): %d\n", white && board->can_castle_bk);
-    printf("pieces clear (Black queenside): %d\n", ((all_pieces & 0x0e00000000000000) == 0));
-    printf("path safe (Black queenside): %d\n", ((all_opp_attacked & 0x7000000000000000) == 0));
-    printf("castle rights (Black queenside): %d\n", white && board->can_castle_bq);
-    printf("-------------------------------\n");*/
-    if (white && board->can_castle_wk && ((all_opp_attacked & 0x0000000000000070) == 0) && ((all_pieces & 0x0000000000000060) == 0))
-    {
-        // white kingside
-        add_move.capture = false;
-        add_move.castle = true;
-        add_move.promotion = 0;
-        add_move.from = board->bb_white_king;
-        add_move.to = bb_slide_e(bb_slide_e(board->bb_white_king));
-        add_to_moves(moves, &len_moves, maxlen_moves, add_move);
+        if (score >= MATE_SCORE - MAX_SEARCH_PLY || score <= -MATE_SCORE + MAX_SEARCH_PLY)
+            break; // a forced mate either way, deeper won't change it
     }
-    if (white && board->can_castle_wq && ((all_opp_attacked & 0x000000000000001c) == 0) && ((all_pieces & 0x000000000000000e) == 0))
+}
+
+static atomic_int search_threads = 1;
+
+// A Lazy SMP helper: searches its own clone of the board alongside the main search, which it
+// only helps through the shared transposition table. See search().
+typedef struct
+{
+    Search state;
+    Board board;
+    int max_depth;
+    thrd_t thread;
+} SearchHelper;
+
+static int search_helper(void *arg)
+{
+    SearchHelper *helper = (SearchHelper *)arg;
+    SearchResult result;
+    deepen(&helper->state, helper->max_depth, &result);
+    return 0;
+}
+
+// Searches [board] by iterative deepening within [limits], see chess_search(). The board is left as it was.
+static SearchResult search(Board *board, const SearchLimits *limits)
+{
+    SearchResult result;
+    memset(&result, 0, sizeof(result));
+    Move moves[MAX_LEGAL_MOVES];
+    int len_moves = get_legal_moves_inplace(board, moves, MAX_LEGAL_MOVES);
+    if (len_moves == 0)
     {
-        // white queenside
-        add_move.capture = false;
-        add_move.castle = true;
-        add_move.promotion = 0;
-        add_move.from = board->bb_white_king;
-        add_move.to = bb_slide_w(bb_slide_w(board->bb_white_king));
-        add_to_moves(moves, &len_moves, maxlen_moves, add_move);
+        result.score = in_check(board) ? -MATE_SCORE : 0;
+        return result;
     }
-    if ((!white) && board->can_castle_bk && ((all_opp_attacked & 0x7000000000000000) == 0) && ((all_pieces & 0x6000000000000000) == 0))
+    result.best_move = moves[0]; // in case not even the first iteration finishes
+
+    Search *state = (Search *)calloc(1, sizeof(Search));
+    if (state == NULL)
+        return result; // out of memory, the first legal move will have to do
+    state->board = board;
+    state->eval = limits->eval;
+    state->eval_data = limits->eval_data;
+    state->tt = limits->tt;
+    for (int piece = 0; piece < 7; piece++)
+        state->piece_values[piece] = limits->piece_values[piece] ? limits->piece_values[piece] : default_piece_values[piece];
+    state->max_nodes = limits->nodes;
+    if (limits->time_ms > 0)
+        state->deadline = monotonic_micros() + limits->time_ms * 1000;
+    int max_depth = MAX_SEARCH_PLY - 1;
+    if (limits->depth > 0 && limits->depth < max_depth)
+        max_depth = limits->depth;
+    else if (limits->depth <= 0 && limits->nodes == 0 && limits->time_ms == 0)
+        max_depth = DEFAULT_SEARCH_DEPTH;
+
+    // Lazy SMP: helper threads search the same position and fill the shared table, which speeds up the main search
+    int num_threads = limits->threads > 0 ? limits->threads : atomic_load(&search_threads);
+    num_threads = num_threads > MAX_SEARCH_THREADS ? MAX_SEARCH_THREADS : num_threads;
+    TranspositionTable *own_tt = NULL;
+    if (num_threads > 1 && state->tt == NULL)
     {
-        // black kingside
-        add_move.capture = false;
-        add_move.castle = true;
-        add_move.promotion = 0;
-        add_move.from = board->bb_black_king;
-        add_move.to = bb_slide_e(bb_slide_e(board->bb_black_king));
-        add_to_moves(moves, &len_moves, maxlen_moves, add_move);
+        own_tt = tt_create(SMP_TT_SIZE_MB);
+        state->tt = own_tt;
+        if (own_tt == NULL)
+            num_threads = 1; // nothing to share results through
     }
-    if ((!white) && board->can_castle_bq && ((all_opp_attacked & 0x1c00000000000000) == 0) && ((all_pieces & 0x0e00000000000000) == 0))
+    if (state->tt != NULL)
+        tt_new_search(state->tt);
+    atomic_bool stop;
+    atomic_init(&stop, false);
+    SearchHelper *helpers = NULL;
+    int num_helpers = 0;
+    if (num_threads > 1)
+        helpers = (SearchHelper *)calloc(num_threads - 1, sizeof(SearchHelper));
+    for (; helpers != NULL && num_helpers < num_threads - 1; num_helpers++)
     {
-        // black queenside
-        add_move.capture = false;
-        add_move.castle = true;
-        add_move.promotion = 0;
-        add_move.from = board->bb_black_king;
-        add_move.to = bb_slide_w(bb_slide_w(board->bb_black_king));
-        add_to_moves(moves, &len_moves, maxlen_moves, add_move);
+        SearchHelper *helper = &helpers[num_helpers];
+        helper->state = *state;
+        helper->state.board = &helper->board;
+        helper->state.max_nodes = 0; // the main search decides when to stop
+        helper->state.shared_stop = &stop;
+        helper->state.depth_skew = (num_helpers + 1) & 1; // half the helpers search a ply deeper, so the threads don't all move in step
+        copy_board(&helper->board, board);
+        helper->max_depth = max_depth;
+        if (thrd_create(&helper->thread, &search_helper, helper) != thrd_success)
+        {
+            release_history(helper->board.history);
+            break; // carry on with fewer threads
+        }
     }
 
-    free(pseudo_moves);
-    free(opp_pseudo_moves);
-
-    return (int)len_moves;
+    deepen(state, max_depth, &result);
+    result.nodes = state->nodes;
+    atomic_store(&stop, true);
+    for (int i = 0; i < num_helpers; i++)
+    {
+        thrd_join(helpers[i].thread, NULL);
+        result.nodes += helpers[i].state.nodes;
+        release_history(helpers[i].board.history);
+    }
+    free(helpers);
+    tt_free(own_tt);
+    free(state);
+    return result;
 }
 
 // Returns the fully legal moves on [board].
@@ -2025,6 +3108,8 @@ static void start_chess_api()
 {
     API = (InternalAPI *)malloc(sizeof(InternalAPI));
     API->shared_board = NULL;
+    API->position_base[0] = '\0';
+    API->position_moves_len = 0;
     API->wtime = 0;
     API->btime = 0;
     memset(&API->latest_opponent_move, 0, sizeof(Move));
@@ -2032,12 +3117,6 @@ static void start_chess_api()
     // sem_init(&API->intermission_mutex, 0, 0);
     mtx_init(&API->mutex, mtx_plain);
     semaphore_init(&API->intermission_mutex, 0);
-    // setup zobrist keys
-    srand(time(NULL));
-    for (int i = 0; i < 781; i++)
-    {
-        zobrist_keys[i] = rand_uint64_t();
-    }
     // start the uci server in its own thread
     uci_start(&API->uci_thread);
     // block until uci endpoint says go
@@ -2047,66 +3126,19 @@ static void start_chess_api()
 // Returns true if a threefold repetition has occurred on [board]
 static bool is_threefold_draw(Board *board)
 {
-    if (API == NULL)
-        start_chess_api();
-    // i hate everything
-    int cur_size = 0;
-    int max_size = 1;
-    Board **boards = (Board **)malloc(sizeof(Board *));
-    int *counts = (int *)malloc(sizeof(int));
-    Board *cur_board = board;
-    bool hit, found = false;
-    while (cur_board)
-    {
-        hit = false;
-        for (int i = 0; i < cur_size; i++)
-        {
-            if (board_equals(boards[i], cur_board))
-            {
-                counts[i]++;
-                hit = true;
-                if (counts[i] >= 3)
-                {
-                    found = true;
-                }
-                break;
-            }
-        }
-        if (found)
-            break;
-        if (!hit)
-        {
-            if (cur_size == max_size)
-            {
-                max_size *= 2;
-                boards = (Board **)realloc(boards, max_size * sizeof(Board *));
-                counts = (int *)realloc(counts, max_size * sizeof(int));
-            }
-            boards[cur_size] = cur_board;
-            counts[cur_size] = 1;
-            cur_size++;
-        }
-        cur_board = cur_board->last_board;
-    }
-    free(boards);
-    free(counts);
-    if (!found)
-        return false;
-    return true;
+    return is_repetition(board, 0, 2);
 }
 
 // Returns GAME_NORMAL, GAME_STALEMATE or GAME_CHECKMATE based on the state on [board]
 static GameState get_board_end_state(Board *board)
 {
-    if (board->halfmoves >= 50)
+    if (board->halfmoves >= FIFTY_MOVE_PLIES)
         return GAME_STALEMATE;
     if (is_threefold_draw(board))
         return GAME_STALEMATE;
-    int num_legal_moves;
-    free(get_legal_moves(board, &num_legal_moves));
-    if (num_legal_moves > 0)
+    if (has_legal_moves(board))
         return GAME_NORMAL;
-    bool check = in_check(board, board->whiteToMove);
+    bool check = in_check(board);
     if (check)
         return GAME_CHECKMATE;
     return GAME_STALEMATE;
@@ -2133,6 +3165,192 @@ int chess_get_legal_moves_inplace(Board *board, Move *moves, size_t maxlen_moves
     return get_legal_moves_inplace(board, moves, maxlen_moves);
 }
 
+int chess_get_legal_captures_inplace(Board *board, Move *moves, size_t maxlen_moves)
+{
+    return generate_moves(board, moves, maxlen_moves, GEN_CAPTURES);
+}
+
+int chess_get_legal_quiets_inplace(Board *board, Move *moves, size_t maxlen_moves)
+{
+    return generate_moves(board, moves, maxlen_moves, GEN_QUIETS);
+}
+
+void chess_init_move_picker(MovePicker *picker, Board *board, Move hash_move, Move killer1, Move killer2)
+{
+    init_move_picker(picker, board, hash_move, killer1, killer2);
+}
+
+bool chess_is_legal_move(Board *board, Move move)
+{
+    return validate_move(board, move, true);
+}
+
+bool chess_is_pseudo_legal_move(Board *board, Move move)
+{
+    return validate_move(board, move, false);
+}
+
+bool chess_next_move(MovePicker *picker, Move *move)
+{
+    return next_move(picker, move);
+}
+
+MoveOrdering *chess_ordering_create(void)
+{
+    return (MoveOrdering *)calloc(1, sizeof(MoveOrdering));
+}
+
+void chess_ordering_free(MoveOrdering *ordering)
+{
+    free(ordering);
+}
+
+void chess_ordering_clear(MoveOrdering *ordering)
+{
+    memset(ordering, 0, sizeof(MoveOrdering));
+}
+
+void chess_ordering_update(MoveOrdering *ordering, Board *board, Move move, int ply, int depth)
+{
+    update_ordering(ordering, board, move, ply, depth);
+}
+
+void chess_score_moves(Board *board, const Move *moves, int len_moves, int *scores, const MoveOrdering *ordering, int ply)
+{
+    for (int i = 0; i < len_moves; i++)
+        scores[i] = ordering_score(ordering, board, moves[i], ply);
+}
+
+void chess_pick_move(Move *moves, int *scores, int len_moves, int index)
+{
+    pick_move(moves, scores, len_moves, index);
+}
+
+uint64_t chess_perft(Board *board, int depth)
+{
+    if (depth <= 1 || atomic_load(&perft_threads) <= 1)
+        return perft(board, depth);
+    Move moves[MAX_LEGAL_MOVES];
+    uint64_t counts[MAX_LEGAL_MOVES];
+    int len_moves = perft_divide(board, depth, moves, counts, MAX_LEGAL_MOVES);
+    uint64_t nodes = 0;
+    for (int i = 0; i < len_moves; i++)
+        nodes += counts[i];
+    return nodes;
+}
+
+int chess_perft_divide(Board *board, int depth, Move *moves, uint64_t *counts, size_t maxlen_moves)
+{
+    return perft_divide(board, depth, moves, counts, maxlen_moves);
+}
+
+void chess_set_perft_threads(int threads)
+{
+    atomic_store(&perft_threads, threads < 1 ? 1 : threads > MAX_PERFT_THREADS ? MAX_PERFT_THREADS : threads);
+}
+
+SearchResult chess_search(Board *board, const SearchLimits *limits)
+{
+    SearchLimits no_limits;
+    if (limits == NULL)
+    {
+        memset(&no_limits, 0, sizeof(no_limits));
+        limits = &no_limits;
+    }
+    return search(board, limits);
+}
+
+void chess_set_search_threads(int threads)
+{
+    atomic_store(&search_threads, threads < 1 ? 1 : threads > MAX_SEARCH_THREADS ? MAX_SEARCH_THREADS : threads);
+}
+
+int chess_evaluate(Board *board)
+{
+    return evaluate(board, default_piece_values);
+}
+
+int chess_see(Board *board, Move move)
+{
+    return see(board, move);
+}
+
+bool chess_see_ge(Board *board, Move move, int threshold)
+{
+    return see_ge(board, move, threshold);
+}
+
+void chess_see_moves(Board *board, const Move *moves, int *scores, size_t len_moves)
+{
+    for (size_t i = 0; i < len_moves; i++)
+        scores[i] = see(board, moves[i]);
+}
+
+TranspositionTable *chess_tt_create(size_t size_mb)
+{
+    return tt_create(size_mb);
+}
+
+void chess_tt_free(TranspositionTable *tt)
+{
+    tt_free(tt);
+}
+
+void chess_tt_clear(TranspositionTable *tt)
+{
+    tt_clear(tt);
+}
+
+void chess_tt_new_search(TranspositionTable *tt)
+{
+    tt_new_search(tt);
+}
+
+bool chess_tt_probe(TranspositionTable *tt, uint64_t key, TTEntry *entry)
+{
+    return tt_probe(tt, key, entry);
+}
+
+void chess_tt_store(TranspositionTable *tt, uint64_t key, Move move, int score, int depth, TTBound bound)
+{
+    tt_store(tt, key, move, score, depth, bound);
+}
+
+void chess_tt_prefetch(TranspositionTable *tt, uint64_t key)
+{
+    tt_prefetch(tt, key);
+}
+
+int chess_tt_hashfull(TranspositionTable *tt)
+{
+    return tt_hashfull(tt);
+}
+
+uint32_t chess_pack_move(Move move)
+{
+    return pack_move(move);
+}
+
+Move chess_unpack_move(uint32_t packed)
+{
+    return unpack_move(packed);
+}
+
+Board *chess_clone_position(Board *board)
+{
+    return clone_position(board);
+}
+
+bool chess_has_legal_moves(Board *board)
+{
+    return has_legal_moves(board);
+}
+
+int chess_count_legal_moves(Board *board)
+{
+    return count_legal_moves(board);
+}
+
 bool chess_is_white_turn(Board *board)
 {
     return is_white_turn(board);
@@ -2159,17 +3377,25 @@ uint64_t chess_zobrist_key(Board *board)
     return board->hash;
 }
 
+bool chess_zobrist_key_from_fen(const char *fen, uint64_t *key)
+{
+    ensure_tables();
+    // parse onto the stack, no history is needed to hash a single position
+    Board board;
+    memset(&board, 0, sizeof(Board));
+    if (!set_board_from_fen(&board, fen))
+        return false;
+    *key = board.hash;
+    return true;
+}
+
 void chess_make_move(Board *board, Move move)
 {
-    if (API == NULL)
-        start_chess_api();
     make_move(board, move);
 }
 
 void chess_undo_move(Board *board)
 {
-    if (API == NULL)
-        start_chess_api();
     undo_move(board);
 }
 
@@ -2178,6 +3404,13 @@ void chess_free_board(Board *board)
     free_board(board);
 }
 
+void chess_get_board_pool_stats(BoardPoolStats *stats)
+{
+    stats->live = atomic_load_explicit(&pool_live_boards, memory_order_relaxed);
+    stats->peak = atomic_load_explicit(&pool_peak_boards, memory_order_relaxed);
+    stats->pooled = atomic_load_explicit(&pool_slab_boards, memory_order_relaxed);
+}
+
 uint64_t chess_get_time_millis()
 {
     if (API == NULL)
@@ -2196,7 +3429,26 @@ uint64_t chess_get_elapsed_time_millis()
 {
     if (API == NULL)
         start_chess_api();
-    return interface_get_elapsed_time_millis();
+    return interface_get_elapsed_time_micros() / 1000;
+}
+
+uint64_t chess_get_elapsed_time_micros()
+{
+    if (API == NULL)
+        start_chess_api();
+    return interface_get_elapsed_time_micros();
+}
+
+uint64_t chess_get_turn_deadline_micros(uint64_t budget_millis)
+{
+    if (API == NULL)
+        start_chess_api();
+    return interface_get_turn_deadline_micros(budget_millis);
+}
+
+uint64_t chess_get_monotonic_micros()
+{
+    return monotonic_micros();
 }
 
 void chess_free_moves_array(Move *moves)
@@ -2225,10 +3477,14 @@ void chess_done()
 
 Board *chess_board_from_fen(const char *fen)
 {
-    Board *board = (Board *)malloc(sizeof(Board));
+    ensure_tables();
+    Board *board = alloc_board();
     memset(board, 0, sizeof(Board));
-    set_board_from_fen(board, fen);
-    board->refcount = 1;
+    if (!set_board_from_fen(board, fen))
+    {
+        free_board(board);
+        return NULL;
+    }
     return board;
 }
 
@@ -2264,7 +3520,7 @@ int chess_get_full_moves(Board *board)
 
 bool chess_is_check(Board *board)
 {
-    return in_check(board, board->whiteToMove);
+    return in_check(board);
 }
 
 void chess_skip_turn(Board *board)
@@ -2276,29 +3532,35 @@ void chess_skip_turn(Board *board)
 
 bool chess_in_check(Board *board)
 {
-    return in_check(board, board->whiteToMove);
+    return in_check(board);
+}
+
+void chess_get_attack_info(Board *board, AttackInfo *info)
+{
+    *info = *get_attack_info(board);
 }
 
 bool chess_in_checkmate(Board *board)
 {
-    int num_legal_moves;
-    free(get_legal_moves(board, &num_legal_moves));
-    if (num_legal_moves > 0)
+    if (has_legal_moves(board))
         return false;
-    return in_check(board, board->whiteToMove);
+    return in_check(board);
 }
 
 bool chess_in_draw(Board *board)
 {
-    if (board->halfmoves >= 50)
+    if (board->halfmoves >= FIFTY_MOVE_PLIES)
         return true;
     if (is_threefold_draw(board))
         return true;
-    int num_legal_moves;
-    free(get_legal_moves(board, &num_legal_moves));
-    if (num_legal_moves > 0)
+    if (has_legal_moves(board))
         return false;
-    return !in_check(board, board->whiteToMove);
+    return !in_check(board);
+}
+
+bool chess_is_repetition(Board *board, int ply)
+{
+    return is_repetition(board, ply, 2);
 }
 
 bool chess_can_kingside_castle(Board *board, PlayerColor color)
@@ -2316,4 +3578,16 @@ Move chess_get_opponent_move()
     if (API == NULL)
         start_chess_api();
     return interface_get_opponent_move();
-}
\ No newline at end of file
+}
+
+void chess_init_headless()
+{
+    // the board functions only need the tables, the UCI server is left for chess_get_board() and the like to start
+    ensure_tables();
+}
+
+const char *chess_get_backend_name()
+{
+    ensure_tables();
+    return bb_backend_name();
+}
@@ -44,6 +44,10 @@ typedef enum
 } GameState;
 
 //! A Board represents a single chess game
+/*!
+A single Board must not be used from two threads at once. Boards cloned from one another may each be used on a different thread,
+including being freed there, since the move history they share is reference counted atomically and never modified while shared.
+*/
 typedef struct Board Board;
 
 //! A Move represents a single chess move from a start location to an end location
@@ -56,6 +60,96 @@ typedef struct
     bool castle;       /*!< True if this move is castling*/
 } Move;
 
+//! AttackInfo describes the checks and pins against the player to move
+typedef struct
+{
+    BitBoard checkers;    /*!< The opposing pieces giving check*/
+    BitBoard check_mask;  /*!< Squares a non-king move must land on: every square if not in check, none in double check*/
+    BitBoard pinned;      /*!< The player's pieces pinned to their king*/
+    BitBoard pin_rays[4]; /*!< Squares pinned pieces may move along, per line: N-S, NE-SW, E-W, SE-NW. Includes the pinners*/
+    BitBoard attacked;    /*!< Squares attacked by the opponent, looking through the player's king*/
+} AttackInfo;
+
+//! MovePicker hands out the legal moves of a position in stages, see chess_init_move_picker()
+/*!
+The fields are private. A MovePicker is large, about 7KB, but needs no freeing.
+*/
+typedef struct
+{
+    Board *board;
+    Move hash_move;
+    Move killers[2];
+    int stage;
+    int index;
+    int len_moves;
+    int scores[256];
+    Move moves[256];
+} MovePicker;
+
+//! MoveOrdering keeps the killer moves and history scores of one search thread, see chess_score_moves()
+typedef struct MoveOrdering MoveOrdering;
+
+//! BoardPoolStats gives a snapshot of the Board allocator
+typedef struct
+{
+    size_t live;   /*!< Boards currently allocated and not yet freed*/
+    size_t peak;   /*!< The most boards ever live at once*/
+    size_t pooled; /*!< Board slots the pool has reserved from the system, used or not*/
+} BoardPoolStats;
+
+//! The kind of score held by a transposition table entry
+typedef enum
+{
+    BOUND_NONE = 0,  /*!< No entry*/
+    BOUND_EXACT = 1, /*!< The score is exact*/
+    BOUND_LOWER = 2, /*!< The real score is at least this, the search failed high*/
+    BOUND_UPPER = 3, /*!< The real score is at most this, the search failed low*/
+} TTBound;
+
+//! A TranspositionTable caches search results by zobrist key. It may be shared by any number of threads
+typedef struct TranspositionTable TranspositionTable;
+
+//! TTEntry is a search result read from a transposition table
+typedef struct
+{
+    Move move;     /*!< The best move found, all zero if none is known*/
+    int score;     /*!< The score for the player to move*/
+    int depth;     /*!< The depth the position was searched to*/
+    TTBound bound; /*!< Whether score is exact or a bound*/
+} TTEntry;
+
+//! An EvalFunction scores a position for chess_search()
+/*!
+\param board The position to score. It must be left as it was.
+\param user_data The eval_data from the SearchLimits
+\return The score in centipawns, from the view of the player to move
+*/
+typedef int (*EvalFunction)(Board *board, void *user_data);
+
+//! SearchLimits tells chess_search() when to stop and how to score positions
+typedef struct
+{
+    int depth;           /*!< The deepest iteration to search, or 0 for no depth limit*/
+    uint64_t nodes;      /*!< Stop after about this many nodes, or 0 for no node limit*/
+    uint64_t time_ms;    /*!< Stop after about this many milliseconds, or 0 for no time limit*/
+    EvalFunction eval;   /*!< Scores the positions searched, or NULL for the built in evaluation*/
+    void *eval_data;     /*!< Passed to eval as is*/
+    int piece_values[7]; /*!< Material values for the built in evaluation, indexed by PieceType. 0 keeps the default*/
+    TranspositionTable *tt; /*!< A table to keep results in between searches, or NULL to search without one*/
+    int threads;            /*!< Threads to search with, or 0 for the number set by chess_set_search_threads()*/
+} SearchLimits;
+
+//! SearchResult is the outcome of chess_search()
+typedef struct
+{
+    Move best_move; /*!< The best move found, all zero if there are no legal moves*/
+    int score;      /*!< The score of the best move in centipawns for the player to move. Mates score 32000 less the number of plies to mate*/
+    int depth;      /*!< The last iteration that finished*/
+    uint64_t nodes; /*!< The number of positions visited*/
+    Move pv[64];    /*!< The expected line of play, starting with best_move*/
+    int pv_len;     /*!< The number of moves in pv*/
+} SearchResult;
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -74,12 +168,23 @@ extern "C"
     //! Returns a clone of the given board
     /*!
     The clone is not a deep clone, but uses reference counting to ensure reused shallow objects are not freed early
+    The clone and the original may be used and freed on different threads, see Board.
     Caller must free the board with free_board
     \sa chess_free_board()
     \return A clone of the given board
     */
     DLLEXPORT Board *chess_clone_board(Board *board);
 
+    //! Returns a copy of the given board's position, without its move history
+    /*!
+    Unlike chess_clone_board(), the copy shares nothing with the original.
+    Moves made before the copy can't be undone on it, and repetitions of earlier positions can't be detected.
+    Caller must free the board with free_board
+    \sa chess_clone_board()
+    \return A copy of the position on the given board
+    */
+    DLLEXPORT Board *chess_clone_position(Board *board);
+
     //! Returns an array of legal moves
     /*!
     Caller must free array
@@ -99,6 +204,233 @@ extern "C"
     */
     DLLEXPORT int chess_get_legal_moves_inplace(Board *board, Move *moves, size_t maxlen_moves);
 
+    //! Returns whether a move is legal, without generating the legal moves
+    /*!
+    Checks the move against the targets of the piece it moves using the board's check and pin information, so it's much cheaper than searching chess_get_legal_moves().
+    The capture, castle and promotion fields must be as move generation would give them. Any move is rejected safely, such as one read from a
+    transposition table entry of another position.
+    \param board The board to consider
+    \param move The move to check, for the player to move
+    \return True if the move is one of the legal moves
+    */
+    DLLEXPORT bool chess_is_legal_move(Board *board, Move move);
+
+    //! Returns whether a move follows the way its piece moves, without checking if it leaves the king in check
+    /*!
+    Like chess_is_legal_move(), but moves of pinned pieces and king moves onto attacked squares are accepted, as are moves ignoring a check.
+    Castling still needs its squares empty and safe.
+    \param board The board to consider
+    \param move The move to check, for the player to move
+    \return True if the move is pseudo-legal
+    */
+    DLLEXPORT bool chess_is_pseudo_legal_move(Board *board, Move move);
+
+    //! Returns the legal captures and promotions
+    /*!
+    Like chess_get_legal_moves_inplace(), but skips quiet moves without generating them. En passant counts as a capture, and every promotion is listed, capturing or not.
+    Together with chess_get_legal_quiets_inplace() this lists every legal move exactly once.
+    \param board The board to get legal moves on
+    \param moves Target array moves are written to
+    \param maxlen_moves The size of the passed moves array
+    \return The number of legal captures and promotions
+    */
+    DLLEXPORT int chess_get_legal_captures_inplace(Board *board, Move *moves, size_t maxlen_moves);
+
+    //! Returns the legal moves that neither capture nor promote
+    /*!
+    Like chess_get_legal_moves_inplace(), but only lists the moves chess_get_legal_captures_inplace() leaves out, castling included.
+    \param board The board to get legal moves on
+    \param moves Target array moves are written to
+    \param maxlen_moves The size of the passed moves array
+    \return The number of legal quiet moves
+    */
+    DLLEXPORT int chess_get_legal_quiets_inplace(Board *board, Move *moves, size_t maxlen_moves);
+
+    //! Sets up a MovePicker to hand out the legal moves of a board in stages
+    /*!
+    The stages are the hash move, captures and promotions by most valuable victim and least valuable attacker,
+    the killer moves, then the quiet moves. Each is generated only once the previous one is used up, so a search which
+    cuts off early skips the rest. Hash and killer moves which aren't legal on the board are left out, and no move is handed out twice.
+    The board must not change while the picker is used.
+    \param picker The picker to set up
+    \param board The board to pick moves on
+    \param hash_move A move to try first, usually from a transposition table, or all zero for none
+    \param killer1 A quiet move to try after the captures, or all zero for none
+    \param killer2 A quiet move to try after killer1, or all zero for none
+    */
+    DLLEXPORT void chess_init_move_picker(MovePicker *picker, Board *board, Move hash_move, Move killer1, Move killer2);
+
+    //! Takes the next move from a MovePicker
+    /*!
+    \param picker The picker, set up by chess_init_move_picker()
+    \param move Receives the move
+    \return False once every legal move was handed out
+    */
+    DLLEXPORT bool chess_next_move(MovePicker *picker, Move *move);
+
+    //! Creates an empty MoveOrdering
+    /*!
+    A MoveOrdering is about 33KB and is not safe to use from two threads at once, give each search thread its own.
+    Free it with chess_ordering_free().
+    \return The new MoveOrdering, or NULL if out of memory
+    */
+    DLLEXPORT MoveOrdering *chess_ordering_create(void);
+
+    //! Frees a MoveOrdering
+    /*!
+    \param ordering The MoveOrdering to free
+    */
+    DLLEXPORT void chess_ordering_free(MoveOrdering *ordering);
+
+    //! Forgets every killer move and history score, usually before a new search
+    /*!
+    \param ordering The MoveOrdering to clear
+    */
+    DLLEXPORT void chess_ordering_clear(MoveOrdering *ordering);
+
+    //! Records that a move caused a beta cutoff
+    /*!
+    Quiet moves become the first killer move of their ply and gain history by depth squared. Captures and promotions are ignored,
+    they are ordered by what they take. History scores are halved once any reaches 16384.
+    \param ordering The MoveOrdering to update
+    \param board The board the move was played on, as it was before the move
+    \param move The move
+    \param ply The number of moves from the root of the search, 0-63. Killers are not kept for other plies
+    \param depth The remaining depth the move was searched at
+    */
+    DLLEXPORT void chess_ordering_update(MoveOrdering *ordering, Board *board, Move move, int ply, int depth);
+
+    //! Scores moves for searching them in order, higher first
+    /*!
+    Captures and queen promotions score 65536 or more, by most valuable victim then least valuable attacker.
+    The killer moves of the ply score 32769 and 32768, other quiet moves their history score below 16384.
+    Underpromotions score 1024 less than they otherwise would.
+    \param board The board the moves are played on
+    \param moves The moves to score
+    \param len_moves The number of moves
+    \param scores Receives a score for each move
+    \param ordering The killers and history to use, or NULL to order by captures alone
+    \param ply The number of moves from the root of the search, for the killer moves
+    */
+    DLLEXPORT void chess_score_moves(Board *board, const Move *moves, int len_moves, int *scores, const MoveOrdering *ordering, int ply);
+
+    //! Moves the best scored move from index onwards to index, swapping its score along
+    /*!
+    Calling this for each index before using the move there sorts the moves lazily, so a search that cuts off early skips sorting the rest.
+    \param moves The moves, as scored by chess_score_moves()
+    \param scores The scores of the moves
+    \param len_moves The number of moves
+    \param index The position to fill
+    */
+    DLLEXPORT void chess_pick_move(Move *moves, int *scores, int len_moves, int index);
+
+    //! Returns whether there are any legal moves
+    /*!
+    Stops at the first legal move found, so this is much cheaper than generating the full list.
+    \param board The board to consider
+    \return True if the current player has at least one legal move
+    */
+    DLLEXPORT bool chess_has_legal_moves(Board *board);
+
+    //! Returns the number of legal moves
+    /*!
+    Counts the moves without writing them out anywhere.
+    \sa chess_get_legal_moves_inplace()
+    \param board The board to consider
+    \return The number of legal moves
+    */
+    DLLEXPORT int chess_count_legal_moves(Board *board);
+
+    //! Counts the positions reachable from the board in exactly the given number of moves
+    /*!
+    This is the standard perft test, useful for checking and benchmarking move generation.
+    Above depth 1 the root moves are split over the threads set by chess_set_perft_threads().
+    The board is left as it was.
+    \param board The board to start from
+    \param depth The number of moves to play out
+    \return The number of leaf positions
+    */
+    DLLEXPORT uint64_t chess_perft(Board *board, int depth);
+
+    //! Runs perft for each legal move on the board
+    /*!
+    Writes the legal moves and the perft count below each of them, which helps to narrow down a perft mismatch.
+    If the arrays are smaller than the number of legal moves then writing will stop at the array boundary but this won't affect the return value.
+    \sa chess_perft()
+    \param board The board to start from
+    \param depth The number of moves to play out, including the root move
+    \param moves Target array the root moves are written to
+    \param counts Target array the count for each root move is written to
+    \param maxlen_moves The size of the passed arrays
+    \return The number of legal moves
+    */
+    DLLEXPORT int chess_perft_divide(Board *board, int depth, Move *moves, uint64_t *counts, size_t maxlen_moves);
+
+    //! Sets how many threads perft splits its root moves over
+    /*!
+    Defaults to 1. Values are clamped to 1-64.
+    \param threads The number of threads to use
+    */
+    DLLEXPORT void chess_set_perft_threads(int threads);
+
+    //! Searches for the best move on the board
+    /*!
+    A principal variation search by iterative deepening, with aspiration windows, null move pruning and a quiescence search.
+    The search stops at whichever limit comes first. If none are set it stops after depth 6.
+    Runs on the calling thread, and leaves the board as it was.
+    With more than one thread, helper threads search copies of the position alongside it and share their results through the transposition table (Lazy SMP).
+    A table of 16MB is made for the search if none is given. The eval function is then called from every thread at once.
+    \param board The position to search
+    \param limits The limits and evaluation to use, or NULL for the defaults
+    \return The best move and line found by the last finished iteration
+    */
+    DLLEXPORT SearchResult chess_search(Board *board, const SearchLimits *limits);
+
+    //! Sets how many threads chess_search() uses when its limits don't say
+    /*!
+    Defaults to 1. Values are clamped to 1-64. The UCI option Threads sets this too.
+    \param threads The number of threads to use
+    */
+    DLLEXPORT void chess_set_search_threads(int threads);
+
+    //! Returns the built in evaluation of the board
+    /*!
+    Material plus piece-square bonuses, as used by chess_search() when no eval is given.
+    \param board The board to evaluate
+    \return The score in centipawns, from the view of the player to move
+    */
+    DLLEXPORT int chess_evaluate(Board *board);
+
+    //! Returns the static exchange evaluation of a move
+    /*!
+    Plays out the captures on the move's target square, each side taking with its least valuable piece and stopping when that's better for it.
+    Sliders lined up behind a piece that captured join in as it leaves. Values are 100, 320, 330, 500 and 900 for pawn, knight, bishop, rook and queen.
+    Pins and checks aren't considered. Quiet moves score the loss of the moving piece if its target is attacked, castling scores 0.
+    \param board The board the move is played on
+    \param move The move to evaluate, from the player to move
+    \return The material won, or lost if negative, in centipawns
+    */
+    DLLEXPORT int chess_see(Board *board, Move move);
+
+    //! Returns true if the static exchange evaluation of a move is at least a threshold
+    /*!
+    Same as chess_see(board, move) >= threshold, but skips the exchange when the victim and attacker alone decide it.
+    \param board The board the move is played on
+    \param move The move to evaluate, from the player to move
+    \param threshold The least material to win, in centipawns
+    \return If the move wins at least threshold
+    */
+    DLLEXPORT bool chess_see_ge(Board *board, Move move, int threshold);
+
+    //! Writes the static exchange evaluation of each of a list of moves, see chess_see()
+    /*!
+    \param board The board the moves are played on
+    \param moves The moves to evaluate
+    \param scores Receives a score for each move
+    \param len_moves The number of moves
+    */
+    DLLEXPORT void chess_see_moves(Board *board, const Move *moves, int *scores, size_t len_moves);
+
     //! Returns whether it is white's turn or not
     /*!
     \sa chess_is_black_turn()
@@ -138,6 +470,14 @@ extern "C"
     */
     DLLEXPORT bool chess_in_checkmate(Board *board);
 
+    //! Returns the checks and pins against the current player
+    /*!
+    The result is cached on the board until the next move, so repeated calls are cheap.
+    \param board The board to consider
+    \param info Filled with the checkers, check mask, pins and attacked squares
+    */
+    DLLEXPORT void chess_get_attack_info(Board *board, AttackInfo *info);
+
     //! Returns whether the current player is in a draw
     /*!
     This function considers positions with no legal moves, the 50-move rule, and threefold repetition as draws.
@@ -146,6 +486,17 @@ extern "C"
     */
     DLLEXPORT bool chess_in_draw(Board *board);
 
+    //! Returns whether the position should be scored as a repetition draw in a search
+    /*!
+    True if the position occurred before within the last ply moves, since the side repeating could do it again, or twice before that.
+    Only the moves since the last capture or pawn move are looked at, every second one, comparing zobrist keys.
+    With ply 0 this is the threefold repetition rule.
+    \param board The board to consider
+    \param ply The number of moves since the root of the search
+    \return True if the position is a repetition
+    */
+    DLLEXPORT bool chess_is_repetition(Board *board, int ply);
+
     //! Returns if the indicated player has kingside castling rights
     /*!
     You lose kingside castling rights if you move your king or the kingside rook
@@ -194,6 +545,17 @@ extern "C"
     */
     DLLEXPORT uint64_t chess_zobrist_key(Board *board);
 
+    //! Returns the Zobrist hash of a position without creating a board
+    /*!
+    The keys are generated from a fixed seed, so the same position hashes to the same value in every run and process.
+    Build with CHESS_ZOBRIST_SEED defined to use a different key set.
+    \param fen The position in Forsyth-Edwards Notation, or NULL for the starting position
+    \param key Set to the same hash chess_zobrist_key() gives for a board created from the FEN
+    \return false, leaving [key] untouched, if the FEN is invalid. See chess_board_from_fen() for what is rejected
+    \sa chess_zobrist_key()
+    */
+    DLLEXPORT bool chess_zobrist_key_from_fen(const char *fen, uint64_t *key);
+
     //! Performs a move on the board
     /*!
     \sa chess_undo_move()
@@ -218,6 +580,14 @@ extern "C"
     */
     DLLEXPORT void chess_free_board(Board *board);
 
+    //! Returns statistics on Board allocation
+    /*!
+    Boards come from per-thread free lists backed by slabs which are kept for reuse, not returned to the system.
+    Building with CHESS_BOARD_POOL=global shares one locked pool between threads, and CHESS_BOARD_POOL=off uses plain malloc.
+    \param stats Filled with the live, peak and pooled board counts
+    */
+    DLLEXPORT void chess_get_board_pool_stats(BoardPoolStats *stats);
+
     //! Returns the BitBoard for the given color and piece type from the board.
     /*!
     For more info on working with BitBoards, see "bitboard.h"
@@ -269,8 +639,11 @@ extern "C"
     /*!
     Caller must free the board with free_board
     \sa chess_free_board()
-    \param fen A FEN string to generate the board from.
-    \return The generated board
+    Invalid FENs are rejected rather than producing a corrupt board: unknown characters, ranks that aren't 8 squares,
+    anything but one king per side, pawns on the first or last rank and malformed side, castling, en passant or move count fields.
+    The castling, en passant and move count fields may be left off.
+    \param fen A FEN string to generate the board from, or NULL for the starting position.
+    \return The generated board, or NULL if the FEN is invalid
     */
     DLLEXPORT Board *chess_board_from_fen(const char *fen);
 
@@ -298,11 +671,118 @@ extern "C"
 
     //! Returns how much time has elapsed this turn, in ms.
     /*!
+    Measured in wall time from when the GUI said go, so time spent in other threads or blocked is not counted twice or missed.
     \sa chess_get_time_millis()
+    \sa chess_get_elapsed_time_micros()
     \return Elapsed time, in milliseconds.
     */
     DLLEXPORT uint64_t chess_get_elapsed_time_millis();
 
+    //! Returns how much time has elapsed this turn, in microseconds.
+    /*!
+    \sa chess_get_elapsed_time_millis()
+    \return Elapsed time, in microseconds.
+    */
+    DLLEXPORT uint64_t chess_get_elapsed_time_micros();
+
+    //! Returns the time at which a time budget for this turn runs out
+    /*!
+    Compute it once per turn and compare chess_get_monotonic_micros() against it, which is cheaper than asking for the elapsed time.
+    \param budget_millis How long the turn may take, counted from when the GUI said go, in milliseconds.
+    \return The deadline, in chess_get_monotonic_micros() time.
+    */
+    DLLEXPORT uint64_t chess_get_turn_deadline_micros(uint64_t budget_millis);
+
+    //! Returns the current time of a monotonic clock, in microseconds.
+    /*!
+    The clock is not changed by adjustments to the system time. Only the difference between two readings is meaningful.
+    \sa chess_get_turn_deadline_micros()
+    \return The current time, in microseconds.
+    */
+    DLLEXPORT uint64_t chess_get_monotonic_micros();
+
+    ///// TRANSPOSITION TABLE /////
+
+    //! Creates an empty transposition table
+    /*!
+    The table is lock free: probes and stores from many threads at once are safe, and a store that races another is dropped rather than mixed up with it.
+    \param size_mb The most memory to use, in megabytes. Rounded down to a power of two number of 64 byte buckets
+    \return The new table, or NULL if out of memory
+    */
+    DLLEXPORT TranspositionTable *chess_tt_create(size_t size_mb);
+
+    //! free() function for TranspositionTable instances
+    /*!
+    \param tt The table to free, which must no longer be in use
+    */
+    DLLEXPORT void chess_tt_free(TranspositionTable *tt);
+
+    //! Removes every entry from the table
+    /*!
+    Unlike the other table functions, this is not safe while other threads use the table.
+    \param tt The table to clear
+    */
+    DLLEXPORT void chess_tt_clear(TranspositionTable *tt);
+
+    //! Marks the start of a new search
+    /*!
+    Entries stored before this are replaced first. chess_search() calls this itself.
+    \param tt The table
+    */
+    DLLEXPORT void chess_tt_new_search(TranspositionTable *tt);
+
+    //! Looks up a position in the table
+    /*!
+    \sa chess_zobrist_key()
+    \param tt The table
+    \param key The zobrist key of the position
+    \param entry Filled with the stored result if found
+    \return Whether the position was found
+    */
+    DLLEXPORT bool chess_tt_probe(TranspositionTable *tt, uint64_t key, TTEntry *entry);
+
+    //! Stores a search result in the table
+    /*!
+    Replaces the entry for the same key, or else the least useful entry sharing its bucket.
+    \param tt The table
+    \param key The zobrist key of the position
+    \param move The best move found, or a zeroed Move to keep the one already stored
+    \param score The score for the player to move, which must fit in 16 bits
+    \param depth The depth searched, 0-255
+    \param bound Whether score is exact or a bound
+    */
+    DLLEXPORT void chess_tt_store(TranspositionTable *tt, uint64_t key, Move move, int score, int depth, TTBound bound);
+
+    //! Hints the CPU to start loading the entries for a key
+    /*!
+    Call this as soon as a key is known, such as right after making a move, so the later probe finds it in cache.
+    \param tt The table
+    \param key The zobrist key that will be probed
+    */
+    DLLEXPORT void chess_tt_prefetch(TranspositionTable *tt, uint64_t key);
+
+    //! Returns how full the table is with entries from the current search
+    /*!
+    \param tt The table
+    \return Parts per thousand, estimated from a sample of the table
+    */
+    DLLEXPORT int chess_tt_hashfull(TranspositionTable *tt);
+
+    //! Packs a move into 17 bits
+    /*!
+    The packed move keeps every field of the move. A zeroed Move packs to 0.
+    \param move The move to pack
+    \return The packed move
+    */
+    DLLEXPORT uint32_t chess_pack_move(Move move);
+
+    //! Unpacks a move packed by chess_pack_move()
+    /*!
+    \param packed The packed move
+    \return The move, all zero if packed is 0
+    */
+    DLLEXPORT Move chess_unpack_move(uint32_t packed);
+
     ///// BITBOARDS /////
 
     //! Returns the type of piece on the square at the given index.
@@ -368,6 +848,22 @@ extern "C"
 
     ///// OTHER /////
 
+    //! Prepares the library for use without a UCI server
+    /*!
+    Builds the lookup tables without starting the UCI server thread, which reads stdin until the GUI says go.
+    Boards from chess_board_from_fen() can then be played, undone, searched and checked for game end, e.g. to analyse games offline.
+    The server is still started by the first call to chess_get_board(), chess_done() or the other match functions.
+    Calling this is optional, and more than once is harmless.
+    */
+    DLLEXPORT void chess_init_headless();
+
+    //! Returns the name of the CPU-specific backend chosen for move generation.
+    /*!
+    One of "scalar", "bmi2", "avx2" or "bmi2+avx2". Set the CHESS_BACKEND environment variable before loading to limit the features used.
+    \return The backend name, a static string.
+    */
+    DLLEXPORT const char *chess_get_backend_name();
+
     //! Returns the last move made by the opponent.
     /*!
     If no moves have been made yet, the returned move will have all its fields set to zero.
@@ -1,5 +1,7 @@
 #define NAPI_VERSION 6
 #include <node_api.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "chessapi/chessapi.h"
 
@@ -194,6 +196,187 @@ napi_value BoardGetLegalMoves(napi_env env, napi_callback_info info)
 
     return arr;
 }
+// lists the moves [generate] gives on the board the method is called on
+napi_value getLegalMovesOfKind(napi_env env, napi_callback_info info, int (*generate)(Board *board, Move *moves, size_t maxlen_moves))
+{
+    napi_status status;
+
+    napi_value this_arg;
+    status = napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL);
+    assert_or_null(status == napi_ok);
+    Board *board = unwrapBoard(env, this_arg);
+    assert_or_null(board != NULL);
+
+    Move moves[256];
+    int len = (*generate)(board, moves, 256);
+
+    napi_value arr;
+    status = napi_create_array_with_length(env, len, &arr);
+    assert_or_null(status == napi_ok);
+
+    for (int i = 0; i < len; i++)
+    {
+        napi_value move = wrapMove(env, moves[i]);
+        assert_or_null(move != NULL);
+        status = napi_set_element(env, arr, i, move);
+        assert_or_null(status == napi_ok);
+    }
+
+    return arr;
+}
+napi_value BoardGetLegalMovesPacked(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    napi_value this_arg;
+    status = napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL);
+    assert_or_null(status == napi_ok);
+    Board *board = unwrapBoard(env, this_arg);
+    assert_or_null(board != NULL);
+
+    Move moves[256];
+    int len = chess_get_legal_moves_inplace(board, moves, 256);
+
+    napi_value buffer;
+    uint32_t *data;
+    status = napi_create_arraybuffer(env, len * sizeof(uint32_t), (void **)&data, &buffer);
+    assert_or_null(status == napi_ok);
+    for (int i = 0; i < len; i++)
+        data[i] = chess_pack_move(moves[i]);
+
+    napi_value res;
+    status = napi_create_typedarray(env, napi_uint32_array, len, buffer, 0, &res);
+    assert_or_null(status == napi_ok);
+
+    return res;
+}
+napi_value BoardGetLegalCaptures(napi_env env, napi_callback_info info)
+{
+    return getLegalMovesOfKind(env, info, chess_get_legal_captures_inplace);
+}
+napi_value BoardGetLegalQuiets(napi_env env, napi_callback_info info)
+{
+    return getLegalMovesOfKind(env, info, chess_get_legal_quiets_inplace);
+}
+napi_value MovePickerNext(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    napi_value this_arg;
+    status = napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL);
+    assert_or_null(status == napi_ok);
+    MovePicker *picker;
+    status = napi_unwrap(env, this_arg, (void **)&picker);
+    assert_or_null(status == napi_ok);
+
+    Move move;
+    if (!chess_next_move(picker, &move))
+    {
+        napi_value res;
+        status = napi_get_null(env, &res);
+        assert_or_null(status == napi_ok);
+        return res;
+    }
+    return wrapMove(env, move);
+}
+void finalize_move_picker(napi_env env, void *finalize_data, void *finalize_hint)
+{
+    MovePicker *picker = (MovePicker *)finalize_data;
+    chess_free_board(picker->board);
+    free(picker);
+}
+// reads an optional Move argument, leaving [move] all zero if it's missing, null or undefined
+bool unwrapOptionalMove(napi_env env, napi_value val, Move *move)
+{
+    napi_status status;
+
+    memset(move, 0, sizeof(Move));
+    if (val == NULL)
+        return true;
+    napi_valuetype type;
+    status = napi_typeof(env, val, &type);
+    assert_or_false(status == napi_ok);
+    if (type == napi_null || type == napi_undefined)
+        return true;
+    return unwrapMove(env, val, move);
+}
+napi_value BoardCreateMovePicker(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    napi_value this_arg;
+    size_t argc = 2;
+    napi_value argv[2] = {NULL, NULL};
+    status = napi_get_cb_info(env, info, &argc, argv, &this_arg, NULL);
+    assert_or_null(status == napi_ok);
+    Board *board = unwrapBoard(env, this_arg);
+    assert_or_null(board != NULL);
+
+    Move hash_move;
+    assert_or_null(unwrapOptionalMove(env, argv[0], &hash_move));
+    Move killers[2];
+    memset(killers, 0, sizeof(killers));
+    bool has_killers = false;
+    if (argv[1] != NULL)
+    {
+        napi_valuetype type;
+        status = napi_typeof(env, argv[1], &type);
+        assert_or_null(status == napi_ok);
+        has_killers = type != napi_null && type != napi_undefined;
+    }
+    if (has_killers)
+    {
+        bool is_array;
+        status = napi_is_array(env, argv[1], &is_array);
+        assert_or_null(status == napi_ok);
+        if (!is_array)
+        {
+            napi_throw_type_error(env, "BADCHESS", "Expected killers to be an array of moves");
+            return NULL;
+        }
+        uint32_t len;
+        status = napi_get_array_length(env, argv[1], &len);
+        assert_or_null(status == napi_ok);
+        for (uint32_t i = 0; i < len && i < 2; i++)
+        {
+            napi_value killer;
+            status = napi_get_element(env, argv[1], i, &killer);
+            assert_or_null(status == napi_ok);
+            assert_or_null(unwrapOptionalMove(env, killer, &killers[i]));
+        }
+    }
+
+    // the picker works on its own copy, so the board may change or be collected while it's in use
+    MovePicker *picker = malloc(sizeof(MovePicker));
+    Board *clone = picker != NULL ? chess_clone_board(board) : NULL;
+    if (clone == NULL)
+    {
+        free(picker);
+        napi_throw_error(env, "BADCHESS", "Out of memory for the move picker");
+        return NULL;
+    }
+    chess_init_move_picker(picker, clone, hash_move, killers[0], killers[1]);
+
+    napi_value obj;
+    status = napi_create_object(env, &obj);
+    if (status == napi_ok)
+    {
+        napi_property_descriptor methods[] = {
+            DECLARE_NAPI_METHOD("next", MovePickerNext),
+        };
+        status = napi_define_properties(env, obj, sizeof(methods) / sizeof(methods[0]), methods);
+    }
+    if (status == napi_ok)
+        status = napi_wrap(env, obj, picker, finalize_move_picker, NULL, NULL);
+    if (status != napi_ok)
+    {
+        finalize_move_picker(env, picker, NULL);
+        napi_throw_error(env, "BADCHESS", "Failed to create the move picker");
+        return NULL;
+    }
+
+    return obj;
+}
 napi_value BoardIsWhiteTurn(napi_env env, napi_callback_info info)
 {
     napi_status status;
@@ -240,7 +423,7 @@ napi_value BoardSkipTurn(napi_env env, napi_callback_info info)
 
     return NULL;
 }
-napi_value BoardInCheck(napi_env env, napi_callback_info info)
+napi_value BoardHasLegalMoves(napi_env env, napi_callback_info info)
 {
     napi_status status;
 
@@ -251,12 +434,12 @@ napi_value BoardInCheck(napi_env env, napi_callback_info info)
     assert_or_null(board != NULL);
 
     napi_value res;
-    status = napi_get_boolean(env, chess_in_check(board), &res);
+    status = napi_get_boolean(env, chess_has_legal_moves(board), &res);
     assert_or_null(status == napi_ok);
 
     return res;
 }
-napi_value BoardInCheckmate(napi_env env, napi_callback_info info)
+napi_value BoardCountLegalMoves(napi_env env, napi_callback_info info)
 {
     napi_status status;
 
@@ -267,12 +450,12 @@ napi_value BoardInCheckmate(napi_env env, napi_callback_info info)
     assert_or_null(board != NULL);
 
     napi_value res;
-    status = napi_get_boolean(env, chess_in_checkmate(board), &res);
+    status = napi_create_uint32(env, (uint32_t)chess_count_legal_moves(board), &res);
     assert_or_null(status == napi_ok);
 
     return res;
 }
-napi_value BoardInDraw(napi_env env, napi_callback_info info)
+napi_value BoardInCheck(napi_env env, napi_callback_info info)
 {
     napi_status status;
 
@@ -283,68 +466,80 @@ napi_value BoardInDraw(napi_env env, napi_callback_info info)
     assert_or_null(board != NULL);
 
     napi_value res;
-    status = napi_get_boolean(env, chess_in_draw(board), &res);
+    status = napi_get_boolean(env, chess_in_check(board), &res);
     assert_or_null(status == napi_ok);
 
     return res;
 }
-napi_value BoardCanKingsideCastle(napi_env env, napi_callback_info info)
+napi_value BoardInCheckmate(napi_env env, napi_callback_info info)
 {
     napi_status status;
 
     napi_value this_arg;
-    size_t argc = 1;
-    napi_value argv[1];
-    status = napi_get_cb_info(env, info, &argc, argv, &this_arg, NULL);
+    status = napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL);
     assert_or_null(status == napi_ok);
     Board *board = unwrapBoard(env, this_arg);
     assert_or_null(board != NULL);
 
-    if (argc < 1)
-    {
-        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
-        return NULL;
-    }
-
-    int color;
-    status = napi_get_value_int32(env, argv[0], &color);
-    assert_or_null(status == napi_ok);
-
     napi_value res;
-    status = napi_get_boolean(env, chess_can_kingside_castle(board, (PlayerColor)color), &res);
+    status = napi_get_boolean(env, chess_in_checkmate(board), &res);
     assert_or_null(status == napi_ok);
 
     return res;
 }
-napi_value BoardCanQueensideCastle(napi_env env, napi_callback_info info)
+napi_value BoardGetAttackInfo(napi_env env, napi_callback_info info)
 {
     napi_status status;
 
     napi_value this_arg;
-    size_t argc = 1;
-    napi_value argv[1];
-    status = napi_get_cb_info(env, info, &argc, argv, &this_arg, NULL);
+    status = napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL);
     assert_or_null(status == napi_ok);
     Board *board = unwrapBoard(env, this_arg);
     assert_or_null(board != NULL);
 
-    if (argc < 1)
+    AttackInfo attack_info;
+    chess_get_attack_info(board, &attack_info);
+
+    napi_value checkers = wrapBitBoard(env, attack_info.checkers);
+    assert_or_null(checkers != NULL);
+
+    napi_value check_mask = wrapBitBoard(env, attack_info.check_mask);
+    assert_or_null(check_mask != NULL);
+
+    napi_value pinned = wrapBitBoard(env, attack_info.pinned);
+    assert_or_null(pinned != NULL);
+
+    napi_value pin_rays;
+    status = napi_create_array_with_length(env, 4, &pin_rays);
+    assert_or_null(status == napi_ok);
+    for (uint32_t i = 0; i < 4; i++)
     {
-        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
-        return NULL;
+        napi_value ray = wrapBitBoard(env, attack_info.pin_rays[i]);
+        assert_or_null(ray != NULL);
+        status = napi_set_element(env, pin_rays, i, ray);
+        assert_or_null(status == napi_ok);
     }
 
-    int color;
-    status = napi_get_value_int32(env, argv[0], &color);
-    assert_or_null(status == napi_ok);
+    napi_value attacked = wrapBitBoard(env, attack_info.attacked);
+    assert_or_null(attacked != NULL);
 
     napi_value res;
-    status = napi_get_boolean(env, chess_can_queenside_castle(board, (PlayerColor)color), &res);
+    status = napi_create_object(env, &res);
+    assert_or_null(status == napi_ok);
+
+    napi_property_descriptor properties[] = {
+        DECLARE_NAPI_PROPERTY("checkers", checkers),
+        DECLARE_NAPI_PROPERTY("checkMask", check_mask),
+        DECLARE_NAPI_PROPERTY("pinned", pinned),
+        DECLARE_NAPI_PROPERTY("pinRays", pin_rays),
+        DECLARE_NAPI_PROPERTY("attacked", attacked),
+    };
+    status = napi_define_properties(env, res, sizeof(properties) / sizeof(properties[0]), properties);
     assert_or_null(status == napi_ok);
 
     return res;
 }
-napi_value BoardGetGameState(napi_env env, napi_callback_info info)
+napi_value BoardInDraw(napi_env env, napi_callback_info info)
 {
     napi_status status;
 
@@ -355,28 +550,37 @@ napi_value BoardGetGameState(napi_env env, napi_callback_info info)
     assert_or_null(board != NULL);
 
     napi_value res;
-    status = napi_create_int32(env, chess_get_game_state(board), &res);
+    status = napi_get_boolean(env, chess_in_draw(board), &res);
     assert_or_null(status == napi_ok);
 
     return res;
 }
-napi_value BoardZobristKey(napi_env env, napi_callback_info info)
+napi_value BoardIsRepetition(napi_env env, napi_callback_info info)
 {
     napi_status status;
 
     napi_value this_arg;
-    status = napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL);
+    size_t argc = 1;
+    napi_value argv[1];
+    status = napi_get_cb_info(env, info, &argc, argv, &this_arg, NULL);
     assert_or_null(status == napi_ok);
     Board *board = unwrapBoard(env, this_arg);
     assert_or_null(board != NULL);
 
+    int32_t ply = 0;
+    if (argc >= 1)
+    {
+        status = napi_get_value_int32(env, argv[0], &ply);
+        assert_or_null(status == napi_ok);
+    }
+
     napi_value res;
-    status = napi_create_bigint_uint64(env, chess_zobrist_key(board), &res);
+    status = napi_get_boolean(env, chess_is_repetition(board, ply), &res);
     assert_or_null(status == napi_ok);
 
     return res;
 }
-napi_value BoardMakeMove(napi_env env, napi_callback_info info)
+napi_value BoardCanKingsideCastle(napi_env env, napi_callback_info info)
 {
     napi_status status;
 
@@ -394,58 +598,45 @@ napi_value BoardMakeMove(napi_env env, napi_callback_info info)
         return NULL;
     }
 
-    Move move;
-    assert_or_null(unwrapMove(env, argv[0], &move));
-
-    chess_make_move(board, move);
-
-    return NULL;
-}
-napi_value BoardUndoMove(napi_env env, napi_callback_info info)
-{
-    napi_status status;
-
-    napi_value this_arg;
-    status = napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL);
+    int color;
+    status = napi_get_value_int32(env, argv[0], &color);
     assert_or_null(status == napi_ok);
-    Board *board = unwrapBoard(env, this_arg);
-    assert_or_null(board != NULL);
 
-    chess_undo_move(board);
+    napi_value res;
+    status = napi_get_boolean(env, chess_can_kingside_castle(board, (PlayerColor)color), &res);
+    assert_or_null(status == napi_ok);
 
-    return NULL;
+    return res;
 }
-napi_value BoardGetBitboard(napi_env env, napi_callback_info info)
+napi_value BoardCanQueensideCastle(napi_env env, napi_callback_info info)
 {
     napi_status status;
 
     napi_value this_arg;
-    size_t argc = 2;
-    napi_value argv[2];
+    size_t argc = 1;
+    napi_value argv[1];
     status = napi_get_cb_info(env, info, &argc, argv, &this_arg, NULL);
     assert_or_null(status == napi_ok);
     Board *board = unwrapBoard(env, this_arg);
     assert_or_null(board != NULL);
 
-    if (argc < 2)
+    if (argc < 1)
     {
-        napi_throw_type_error(env, "BADCHESS", "Expected at least 2 args");
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
         return NULL;
     }
 
     int color;
     status = napi_get_value_int32(env, argv[0], &color);
     assert_or_null(status == napi_ok);
-    int piece_type;
-    status = napi_get_value_int32(env, argv[1], &piece_type);
-    assert_or_null(status == napi_ok);
 
-    napi_value res = wrapBitBoard(env, chess_get_bitboard(board, (PlayerColor)color, (PieceType)piece_type));
-    assert_or_null(res != NULL);
+    napi_value res;
+    status = napi_get_boolean(env, chess_can_queenside_castle(board, (PlayerColor)color), &res);
+    assert_or_null(status == napi_ok);
 
     return res;
 }
-napi_value BoardGetFullMoves(napi_env env, napi_callback_info info)
+napi_value BoardGetGameState(napi_env env, napi_callback_info info)
 {
     napi_status status;
 
@@ -456,12 +647,12 @@ napi_value BoardGetFullMoves(napi_env env, napi_callback_info info)
     assert_or_null(board != NULL);
 
     napi_value res;
-    status = napi_create_int32(env, chess_get_full_moves(board), &res);
+    status = napi_create_int32(env, chess_get_game_state(board), &res);
     assert_or_null(status == napi_ok);
 
     return res;
 }
-napi_value BoardGetHalfMoves(napi_env env, napi_callback_info info)
+napi_value BoardZobristKey(napi_env env, napi_callback_info info)
 {
     napi_status status;
 
@@ -472,12 +663,13 @@ napi_value BoardGetHalfMoves(napi_env env, napi_callback_info info)
     assert_or_null(board != NULL);
 
     napi_value res;
-    status = napi_create_int32(env, chess_get_half_moves(board), &res);
+    status = napi_create_bigint_uint64(env, chess_zobrist_key(board), &res);
     assert_or_null(status == napi_ok);
 
     return res;
 }
-napi_value BoardGetPieceFromIndex(napi_env env, napi_callback_info info)
+// calls [check] with the move given to the method and the board it's called on
+napi_value checkMove(napi_env env, napi_callback_info info, bool (*check)(Board *board, Move move))
 {
     napi_status status;
 
@@ -495,17 +687,24 @@ napi_value BoardGetPieceFromIndex(napi_env env, napi_callback_info info)
         return NULL;
     }
 
-    int index;
-    status = napi_get_value_int32(env, argv[0], &index);
-    assert_or_null(status == napi_ok);
+    Move move;
+    assert_or_null(unwrapMove(env, argv[0], &move));
 
     napi_value res;
-    status = napi_create_int32(env, chess_get_piece_from_index(board, index), &res);
+    status = napi_get_boolean(env, (*check)(board, move), &res);
     assert_or_null(status == napi_ok);
 
     return res;
 }
-napi_value BoardGetPieceFromBitboard(napi_env env, napi_callback_info info)
+napi_value BoardIsLegalMove(napi_env env, napi_callback_info info)
+{
+    return checkMove(env, info, chess_is_legal_move);
+}
+napi_value BoardIsPseudoLegalMove(napi_env env, napi_callback_info info)
+{
+    return checkMove(env, info, chess_is_pseudo_legal_move);
+}
+napi_value BoardSee(napi_env env, napi_callback_info info)
 {
     napi_status status;
 
@@ -523,44 +722,46 @@ napi_value BoardGetPieceFromBitboard(napi_env env, napi_callback_info info)
         return NULL;
     }
 
-    BitBoard bb = unwrapBitBoard(env, argv[0]);
-    assert_or_null(bb != UINT64_MAX);
+    Move move;
+    assert_or_null(unwrapMove(env, argv[0], &move));
 
     napi_value res;
-    status = napi_create_int32(env, chess_get_piece_from_bitboard(board, bb), &res);
+    status = napi_create_int32(env, chess_see(board, move), &res);
     assert_or_null(status == napi_ok);
 
     return res;
 }
-napi_value BoardGetColorFromIndex(napi_env env, napi_callback_info info)
+napi_value BoardSeeGe(napi_env env, napi_callback_info info)
 {
     napi_status status;
 
     napi_value this_arg;
-    size_t argc = 1;
-    napi_value argv[1];
+    size_t argc = 2;
+    napi_value argv[2];
     status = napi_get_cb_info(env, info, &argc, argv, &this_arg, NULL);
     assert_or_null(status == napi_ok);
     Board *board = unwrapBoard(env, this_arg);
     assert_or_null(board != NULL);
 
-    if (argc < 1)
+    if (argc < 2)
     {
-        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 2 args");
         return NULL;
     }
 
-    int index;
-    status = napi_get_value_int32(env, argv[0], &index);
+    Move move;
+    assert_or_null(unwrapMove(env, argv[0], &move));
+    int32_t threshold;
+    status = napi_get_value_int32(env, argv[1], &threshold);
     assert_or_null(status == napi_ok);
 
     napi_value res;
-    status = napi_create_int32(env, chess_get_color_from_index(board, index), &res);
+    status = napi_get_boolean(env, chess_see_ge(board, move, threshold), &res);
     assert_or_null(status == napi_ok);
 
     return res;
 }
-napi_value BoardGetColorFromBitboard(napi_env env, napi_callback_info info)
+napi_value BoardSeeMoves(napi_env env, napi_callback_info info)
 {
     napi_status status;
 
@@ -572,17 +773,252 @@ napi_value BoardGetColorFromBitboard(napi_env env, napi_callback_info info)
     Board *board = unwrapBoard(env, this_arg);
     assert_or_null(board != NULL);
 
-    if (argc < 1)
+    bool is_array = false;
+    if (argc >= 1)
     {
-        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        status = napi_is_array(env, argv[0], &is_array);
+        assert_or_null(status == napi_ok);
+    }
+    if (!is_array)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected an array of moves");
         return NULL;
     }
+    uint32_t len;
+    status = napi_get_array_length(env, argv[0], &len);
+    assert_or_null(status == napi_ok);
 
-    BitBoard bb = unwrapBitBoard(env, argv[0]);
-    assert_or_null(bb != UINT64_MAX);
+    napi_value buffer;
+    void *data;
+    status = napi_create_arraybuffer(env, len * sizeof(int32_t), &data, &buffer);
+    assert_or_null(status == napi_ok);
+    Move *moves = malloc((len ? len : 1) * sizeof(Move));
+    for (uint32_t i = 0; i < len; i++)
+    {
+        napi_value move_js;
+        status = napi_get_element(env, argv[0], i, &move_js);
+        if (status != napi_ok || !unwrapMove(env, move_js, &moves[i]))
+        {
+            free(moves);
+            return NULL;
+        }
+    }
+    chess_see_moves(board, moves, (int *)data, len);
+    free(moves);
 
     napi_value res;
-    status = napi_create_int32(env, chess_get_color_from_bitboard(board, bb), &res);
+    status = napi_create_typedarray(env, napi_int32_array, len, buffer, 0, &res);
+    assert_or_null(status == napi_ok);
+
+    return res;
+}
+napi_value BoardMakeMove(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    napi_value this_arg;
+    size_t argc = 1;
+    napi_value argv[1];
+    status = napi_get_cb_info(env, info, &argc, argv, &this_arg, NULL);
+    assert_or_null(status == napi_ok);
+    Board *board = unwrapBoard(env, this_arg);
+    assert_or_null(board != NULL);
+
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        return NULL;
+    }
+
+    Move move;
+    assert_or_null(unwrapMove(env, argv[0], &move));
+
+    chess_make_move(board, move);
+
+    return NULL;
+}
+napi_value BoardUndoMove(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    napi_value this_arg;
+    status = napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL);
+    assert_or_null(status == napi_ok);
+    Board *board = unwrapBoard(env, this_arg);
+    assert_or_null(board != NULL);
+
+    chess_undo_move(board);
+
+    return NULL;
+}
+napi_value BoardGetBitboard(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    napi_value this_arg;
+    size_t argc = 2;
+    napi_value argv[2];
+    status = napi_get_cb_info(env, info, &argc, argv, &this_arg, NULL);
+    assert_or_null(status == napi_ok);
+    Board *board = unwrapBoard(env, this_arg);
+    assert_or_null(board != NULL);
+
+    if (argc < 2)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 2 args");
+        return NULL;
+    }
+
+    int color;
+    status = napi_get_value_int32(env, argv[0], &color);
+    assert_or_null(status == napi_ok);
+    int piece_type;
+    status = napi_get_value_int32(env, argv[1], &piece_type);
+    assert_or_null(status == napi_ok);
+
+    napi_value res = wrapBitBoard(env, chess_get_bitboard(board, (PlayerColor)color, (PieceType)piece_type));
+    assert_or_null(res != NULL);
+
+    return res;
+}
+napi_value BoardGetFullMoves(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    napi_value this_arg;
+    status = napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL);
+    assert_or_null(status == napi_ok);
+    Board *board = unwrapBoard(env, this_arg);
+    assert_or_null(board != NULL);
+
+    napi_value res;
+    status = napi_create_int32(env, chess_get_full_moves(board), &res);
+    assert_or_null(status == napi_ok);
+
+    return res;
+}
+napi_value BoardGetHalfMoves(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    napi_value this_arg;
+    status = napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL);
+    assert_or_null(status == napi_ok);
+    Board *board = unwrapBoard(env, this_arg);
+    assert_or_null(board != NULL);
+
+    napi_value res;
+    status = napi_create_int32(env, chess_get_half_moves(board), &res);
+    assert_or_null(status == napi_ok);
+
+    return res;
+}
+napi_value BoardGetPieceFromIndex(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    napi_value this_arg;
+    size_t argc = 1;
+    napi_value argv[1];
+    status = napi_get_cb_info(env, info, &argc, argv, &this_arg, NULL);
+    assert_or_null(status == napi_ok);
+    Board *board = unwrapBoard(env, this_arg);
+    assert_or_null(board != NULL);
+
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        return NULL;
+    }
+
+    int index;
+    status = napi_get_value_int32(env, argv[0], &index);
+    assert_or_null(status == napi_ok);
+
+    napi_value res;
+    status = napi_create_int32(env, chess_get_piece_from_index(board, index), &res);
+    assert_or_null(status == napi_ok);
+
+    return res;
+}
+napi_value BoardGetPieceFromBitboard(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    napi_value this_arg;
+    size_t argc = 1;
+    napi_value argv[1];
+    status = napi_get_cb_info(env, info, &argc, argv, &this_arg, NULL);
+    assert_or_null(status == napi_ok);
+    Board *board = unwrapBoard(env, this_arg);
+    assert_or_null(board != NULL);
+
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        return NULL;
+    }
+
+    BitBoard bb = unwrapBitBoard(env, argv[0]);
+    assert_or_null(bb != UINT64_MAX);
+
+    napi_value res;
+    status = napi_create_int32(env, chess_get_piece_from_bitboard(board, bb), &res);
+    assert_or_null(status == napi_ok);
+
+    return res;
+}
+napi_value BoardGetColorFromIndex(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    napi_value this_arg;
+    size_t argc = 1;
+    napi_value argv[1];
+    status = napi_get_cb_info(env, info, &argc, argv, &this_arg, NULL);
+    assert_or_null(status == napi_ok);
+    Board *board = unwrapBoard(env, this_arg);
+    assert_or_null(board != NULL);
+
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        return NULL;
+    }
+
+    int index;
+    status = napi_get_value_int32(env, argv[0], &index);
+    assert_or_null(status == napi_ok);
+
+    napi_value res;
+    status = napi_create_int32(env, chess_get_color_from_index(board, index), &res);
+    assert_or_null(status == napi_ok);
+
+    return res;
+}
+napi_value BoardGetColorFromBitboard(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    napi_value this_arg;
+    size_t argc = 1;
+    napi_value argv[1];
+    status = napi_get_cb_info(env, info, &argc, argv, &this_arg, NULL);
+    assert_or_null(status == napi_ok);
+    Board *board = unwrapBoard(env, this_arg);
+    assert_or_null(board != NULL);
+
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        return NULL;
+    }
+
+    BitBoard bb = unwrapBitBoard(env, argv[0]);
+    assert_or_null(bb != UINT64_MAX);
+
+    napi_value res;
+    status = napi_create_int32(env, chess_get_color_from_bitboard(board, bb), &res);
     assert_or_null(status == napi_ok);
 
     return res;
@@ -618,16 +1054,29 @@ napi_value wrapBoard(napi_env env, Board *board)
     napi_property_descriptor methods[] = {
         DECLARE_NAPI_METHOD("clone", BoardClone),
         DECLARE_NAPI_METHOD("getLegalMoves", BoardGetLegalMoves),
+        DECLARE_NAPI_METHOD("getLegalMovesPacked", BoardGetLegalMovesPacked),
+        DECLARE_NAPI_METHOD("getLegalCaptures", BoardGetLegalCaptures),
+        DECLARE_NAPI_METHOD("getLegalQuiets", BoardGetLegalQuiets),
+        DECLARE_NAPI_METHOD("createMovePicker", BoardCreateMovePicker),
+        DECLARE_NAPI_METHOD("isLegalMove", BoardIsLegalMove),
+        DECLARE_NAPI_METHOD("isPseudoLegalMove", BoardIsPseudoLegalMove),
         DECLARE_NAPI_METHOD("isWhiteTurn", BoardIsWhiteTurn),
         DECLARE_NAPI_METHOD("isBlackTurn", BoardIsBlackTurn),
         DECLARE_NAPI_METHOD("skipTurn", BoardSkipTurn),
+        DECLARE_NAPI_METHOD("hasLegalMoves", BoardHasLegalMoves),
+        DECLARE_NAPI_METHOD("countLegalMoves", BoardCountLegalMoves),
         DECLARE_NAPI_METHOD("inCheck", BoardInCheck),
         DECLARE_NAPI_METHOD("inCheckmate", BoardInCheckmate),
+        DECLARE_NAPI_METHOD("getAttackInfo", BoardGetAttackInfo),
         DECLARE_NAPI_METHOD("inDraw", BoardInDraw),
+        DECLARE_NAPI_METHOD("isRepetition", BoardIsRepetition),
         DECLARE_NAPI_METHOD("canKingsideCastle", BoardCanKingsideCastle),
         DECLARE_NAPI_METHOD("canQueensideCastle", BoardCanQueensideCastle),
         DECLARE_NAPI_METHOD("getGameState", BoardGetGameState),
         DECLARE_NAPI_METHOD("zobristKey", BoardZobristKey),
+        DECLARE_NAPI_METHOD("see", BoardSee),
+        DECLARE_NAPI_METHOD("seeGe", BoardSeeGe),
+        DECLARE_NAPI_METHOD("seeMoves", BoardSeeMoves),
         DECLARE_NAPI_METHOD("makeMove", BoardMakeMove),
         DECLARE_NAPI_METHOD("undoMove", BoardUndoMove),
         DECLARE_NAPI_METHOD("getBitboard", BoardGetBitboard),
@@ -706,6 +1155,49 @@ napi_value GetElapsedTimeMillis(napi_env env, napi_callback_info info)
 
     return ms;
 }
+napi_value GetElapsedTimeMicros(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+    napi_value us;
+    status = napi_create_int64(env, (int64_t)chess_get_elapsed_time_micros(), &us);
+    assert_or_null(status == napi_ok);
+
+    return us;
+}
+napi_value GetTurnDeadlineMicros(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    size_t argc = 1;
+    napi_value argv[1];
+    status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+    assert_or_null(status == napi_ok);
+
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        return NULL;
+    }
+
+    int64_t budget_ms;
+    status = napi_get_value_int64(env, argv[0], &budget_ms);
+    assert_or_null(status == napi_ok);
+
+    napi_value us;
+    status = napi_create_int64(env, (int64_t)chess_get_turn_deadline_micros(budget_ms > 0 ? (uint64_t)budget_ms : 0), &us);
+    assert_or_null(status == napi_ok);
+
+    return us;
+}
+napi_value GetMonotonicMicros(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+    napi_value us;
+    status = napi_create_int64(env, (int64_t)chess_get_monotonic_micros(), &us);
+    assert_or_null(status == napi_ok);
+
+    return us;
+}
 napi_value GetIndexFromBitboard(napi_env env, napi_callback_info info)
 {
     napi_status status;
@@ -749,14 +1241,1040 @@ napi_value GetBitboardFromIndex(napi_env env, napi_callback_info info)
 
     return wrapBitBoard(env, chess_get_bitboard_from_index(idx));
 }
-napi_value GetOpponentMove(napi_env env, napi_callback_info info)
-{
-    return wrapMove(env, chess_get_opponent_move());
-}
-
-napi_value Init(napi_env env, napi_value exports)
+napi_value Popcount(napi_env env, napi_callback_info info)
 {
     napi_status status;
+    napi_value count;
+
+    size_t argc = 1;
+    napi_value argv[1];
+    status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+    assert_or_null(status == napi_ok);
+
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        return NULL;
+    }
+
+    BitBoard bb = unwrapBitBoard(env, argv[0]);
+    assert_or_null(bb != UINT64_MAX);
+
+    status = napi_create_uint32(env, bb_popcount(bb), &count);
+    assert_or_null(status == napi_ok);
+
+    return count;
+}
+napi_value GetIndicesFromBitboard(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    size_t argc = 1;
+    napi_value argv[1];
+    status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+    assert_or_null(status == napi_ok);
+
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        return NULL;
+    }
+
+    BitBoard bb = unwrapBitBoard(env, argv[0]);
+    assert_or_null(bb != UINT64_MAX);
+
+    int squares[64];
+    int len = bb_serialize(bb, squares);
+
+    napi_value arr;
+    status = napi_create_array_with_length(env, len, &arr);
+    assert_or_null(status == napi_ok);
+    for (int i = 0; i < len; i++)
+    {
+        napi_value idx;
+        status = napi_create_uint32(env, squares[i], &idx);
+        assert_or_null(status == napi_ok);
+        status = napi_set_element(env, arr, i, idx);
+        assert_or_null(status == napi_ok);
+    }
+
+    return arr;
+}
+napi_value InitHeadless(napi_env env, napi_callback_info info)
+{
+    chess_init_headless();
+    return NULL;
+}
+napi_value GetBackend(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    napi_value name;
+    status = napi_create_string_utf8(env, chess_get_backend_name(), NAPI_AUTO_LENGTH, &name);
+    assert_or_null(status == napi_ok);
+
+    return name;
+}
+napi_value BoardFromFen(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    size_t argc = 1;
+    napi_value argv[1];
+    status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+    assert_or_null(status == napi_ok);
+
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        return NULL;
+    }
+
+    char fen[256];
+    status = napi_get_value_string_utf8(env, argv[0], fen, sizeof(fen), NULL);
+    assert_or_null(status == napi_ok);
+
+    Board *board = chess_board_from_fen(fen);
+    if (board == NULL)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Invalid FEN");
+        return NULL;
+    }
+    return wrapBoard(env, board);
+}
+napi_value ZobristKeyFromFen(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    size_t argc = 1;
+    napi_value argv[1];
+    status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+    assert_or_null(status == napi_ok);
+
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        return NULL;
+    }
+
+    char fen[256];
+    status = napi_get_value_string_utf8(env, argv[0], fen, sizeof(fen), NULL);
+    assert_or_null(status == napi_ok);
+
+    uint64_t key;
+    if (!chess_zobrist_key_from_fen(fen, &key))
+    {
+        napi_throw_type_error(env, "BADCHESS", "Invalid FEN");
+        return NULL;
+    }
+
+    napi_value res;
+    status = napi_create_bigint_uint64(env, key, &res);
+    assert_or_null(status == napi_ok);
+
+    return res;
+}
+napi_value SetPerftThreads(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    size_t argc = 1;
+    napi_value argv[1];
+    status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+    assert_or_null(status == napi_ok);
+
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        return NULL;
+    }
+    int threads;
+    status = napi_get_value_int32(env, argv[0], &threads);
+    assert_or_null(status == napi_ok);
+
+    chess_set_perft_threads(threads);
+    return NULL;
+}
+
+// Reports that async work couldn't be started. Once [deferred] exists its promise is rejected and returned, as throwing
+// would leave it pending forever; before that, [message] is thrown. Either way JS sees a BADCHESS error.
+napi_value failAsyncWork(napi_env env, napi_deferred deferred, napi_value promise, const char *message)
+{
+    if (deferred == NULL)
+    {
+        napi_throw_error(env, "BADCHESS", message);
+        return NULL;
+    }
+    napi_value code, msg, err;
+    napi_create_string_utf8(env, "BADCHESS", NAPI_AUTO_LENGTH, &code);
+    napi_create_string_utf8(env, message, NAPI_AUTO_LENGTH, &msg);
+    napi_create_error(env, code, msg, &err);
+    napi_reject_deferred(env, deferred, err);
+    return promise;
+}
+// State for a perft run on the libuv thread pool. The board is a private copy, so JS may keep using its own.
+typedef struct
+{
+    napi_async_work work;
+    napi_deferred deferred;
+    Board *board;
+    int depth;
+    bool divide;
+    uint64_t nodes;
+    int len_moves;
+    Move moves[256];
+    uint64_t counts[256];
+} PerftRequest;
+
+void PerftExecute(napi_env env, void *data)
+{
+    PerftRequest *req = (PerftRequest *)data;
+    if (req->divide)
+        req->len_moves = chess_perft_divide(req->board, req->depth, req->moves, req->counts, 256);
+    else
+        req->nodes = chess_perft(req->board, req->depth);
+}
+void PerftComplete(napi_env env, napi_status status, void *data)
+{
+    PerftRequest *req = (PerftRequest *)data;
+    napi_value res = NULL;
+    if (status == napi_ok && req->divide)
+    {
+        // an object from move notation to count, as perft divide output is usually given
+        status = napi_create_object(env, &res);
+        for (int i = 0; i < req->len_moves && status == napi_ok; i++)
+        {
+            char move_str[7];
+            chess_dump_move(move_str, req->moves[i]);
+            napi_value count;
+            status = napi_create_double(env, (double)req->counts[i], &count);
+            if (status == napi_ok)
+                status = napi_set_named_property(env, res, move_str, count);
+        }
+    }
+    else if (status == napi_ok)
+    {
+        status = napi_create_double(env, (double)req->nodes, &res);
+    }
+    if (status == napi_ok)
+    {
+        napi_resolve_deferred(env, req->deferred, res);
+    }
+    else
+    {
+        napi_value msg, err;
+        napi_create_string_utf8(env, "perft failed", NAPI_AUTO_LENGTH, &msg);
+        napi_create_error(env, NULL, msg, &err);
+        napi_reject_deferred(env, req->deferred, err);
+    }
+    napi_delete_async_work(env, req->work);
+    chess_free_board(req->board);
+    free(req);
+}
+// Shared by Perft and PerftDivide, which take (board, depth) and return a promise.
+napi_value QueuePerft(napi_env env, napi_callback_info info, bool divide)
+{
+    napi_status status;
+
+    size_t argc = 2;
+    napi_value argv[2];
+    status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+    assert_or_null(status == napi_ok);
+
+    if (argc < 2)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 2 args");
+        return NULL;
+    }
+    Board *board = unwrapBoard(env, argv[0]);
+    assert_or_null(board != NULL);
+    int depth;
+    status = napi_get_value_int32(env, argv[1], &depth);
+    assert_or_null(status == napi_ok);
+
+    PerftRequest *req = (PerftRequest *)malloc(sizeof(PerftRequest));
+    Board *clone = req != NULL ? chess_clone_position(board) : NULL;
+    if (clone == NULL)
+    {
+        free(req);
+        napi_throw_error(env, "BADCHESS", "Out of memory for perft");
+        return NULL;
+    }
+    req->work = NULL;
+    req->deferred = NULL;
+    req->board = clone;
+    req->depth = depth;
+    req->divide = divide;
+    req->nodes = 0;
+    req->len_moves = 0;
+
+    napi_value promise = NULL;
+    status = napi_create_promise(env, &req->deferred, &promise);
+    napi_value name;
+    if (status == napi_ok)
+        status = napi_create_string_utf8(env, "chessapi:perft", NAPI_AUTO_LENGTH, &name);
+    if (status == napi_ok)
+        status = napi_create_async_work(env, NULL, name, PerftExecute, PerftComplete, req, &req->work);
+    if (status == napi_ok)
+        status = napi_queue_async_work(env, req->work);
+    if (status != napi_ok)
+    {
+        napi_deferred deferred = promise != NULL ? req->deferred : NULL;
+        if (req->work != NULL)
+            napi_delete_async_work(env, req->work);
+        chess_free_board(req->board);
+        free(req);
+        return failAsyncWork(env, deferred, promise, "Failed to start perft");
+    }
+
+    return promise;
+}
+napi_value Perft(napi_env env, napi_callback_info info)
+{
+    return QueuePerft(env, info, false);
+}
+napi_value PerftDivide(napi_env env, napi_callback_info info)
+{
+    return QueuePerft(env, info, true);
+}
+// Transposition tables
+
+TranspositionTable *unwrapTranspositionTable(napi_env env, napi_value this)
+{
+    TranspositionTable *tt;
+    napi_status status = napi_unwrap(env, this, (void **)&tt);
+    if (status != napi_ok)
+        return NULL;
+    if (tt == NULL)
+    {
+        napi_throw_error(env, "BADCHESS", "Got null pointer when unwrapping TranspositionTable");
+        return NULL;
+    }
+    return tt;
+}
+// Reads a zobrist key, which must be a bigint. Returns false with an exception pending otherwise.
+bool unwrapKey(napi_env env, napi_value val, uint64_t *key)
+{
+    bool lossless;
+    napi_status status = napi_get_value_bigint_uint64(env, val, key, &lossless);
+    if (status == napi_bigint_expected)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected a bigint key");
+        return false;
+    }
+    assert_or_false(status == napi_ok);
+    return true;
+}
+// Shared start of the table methods taking arguments: unwraps this and checks there are at least [min_argc] args.
+TranspositionTable *getTranspositionTableArgs(napi_env env, napi_callback_info info, size_t *argc, napi_value *argv, size_t min_argc)
+{
+    napi_status status;
+
+    napi_value this_arg;
+    status = napi_get_cb_info(env, info, argc, argv, &this_arg, NULL);
+    assert_or_null(status == napi_ok);
+    if (*argc < min_argc)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected more args");
+        return NULL;
+    }
+    return unwrapTranspositionTable(env, this_arg);
+}
+napi_value TranspositionTableProbe(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    size_t argc = 2;
+    napi_value argv[2];
+    TranspositionTable *tt = getTranspositionTableArgs(env, info, &argc, argv, 2);
+    assert_or_null(tt != NULL);
+    uint64_t key;
+    assert_or_null(unwrapKey(env, argv[0], &key));
+    napi_typedarray_type type;
+    size_t length;
+    void *data;
+    bool is_typedarray;
+    status = napi_is_typedarray(env, argv[1], &is_typedarray);
+    assert_or_null(status == napi_ok);
+    if (is_typedarray)
+    {
+        status = napi_get_typedarray_info(env, argv[1], &type, &length, &data, NULL, NULL);
+        assert_or_null(status == napi_ok);
+    }
+    if (!is_typedarray || type != napi_int32_array || length < 4)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected an Int32Array of at least 4 elements");
+        return NULL;
+    }
+
+    TTEntry entry;
+    bool found = chess_tt_probe(tt, key, &entry);
+    if (found)
+    {
+        int32_t *out = (int32_t *)data;
+        out[0] = (int32_t)chess_pack_move(entry.move);
+        out[1] = entry.score;
+        out[2] = entry.depth;
+        out[3] = entry.bound;
+    }
+
+    napi_value res;
+    status = napi_get_boolean(env, found, &res);
+    assert_or_null(status == napi_ok);
+
+    return res;
+}
+napi_value TranspositionTableStore(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    size_t argc = 5;
+    napi_value argv[5];
+    TranspositionTable *tt = getTranspositionTableArgs(env, info, &argc, argv, 5);
+    assert_or_null(tt != NULL);
+    uint64_t key;
+    assert_or_null(unwrapKey(env, argv[0], &key));
+    uint32_t move;
+    status = napi_get_value_uint32(env, argv[1], &move);
+    assert_or_null(status == napi_ok);
+    int32_t score;
+    status = napi_get_value_int32(env, argv[2], &score);
+    assert_or_null(status == napi_ok);
+    int32_t depth;
+    status = napi_get_value_int32(env, argv[3], &depth);
+    assert_or_null(status == napi_ok);
+    uint32_t bound;
+    status = napi_get_value_uint32(env, argv[4], &bound);
+    assert_or_null(status == napi_ok);
+    if (bound < BOUND_EXACT || bound > BOUND_UPPER)
+    {
+        napi_throw_range_error(env, "BADCHESS", "Expected bound to be one of the Bound constants");
+        return NULL;
+    }
+
+    chess_tt_store(tt, key, chess_unpack_move(move), score, depth, (TTBound)bound);
+    return NULL;
+}
+napi_value TranspositionTablePrefetch(napi_env env, napi_callback_info info)
+{
+    size_t argc = 1;
+    napi_value argv[1];
+    TranspositionTable *tt = getTranspositionTableArgs(env, info, &argc, argv, 1);
+    assert_or_null(tt != NULL);
+    uint64_t key;
+    assert_or_null(unwrapKey(env, argv[0], &key));
+
+    chess_tt_prefetch(tt, key);
+    return NULL;
+}
+napi_value TranspositionTableClear(napi_env env, napi_callback_info info)
+{
+    size_t argc = 0;
+    TranspositionTable *tt = getTranspositionTableArgs(env, info, &argc, NULL, 0);
+    assert_or_null(tt != NULL);
+
+    chess_tt_clear(tt);
+    return NULL;
+}
+napi_value TranspositionTableNewSearch(napi_env env, napi_callback_info info)
+{
+    size_t argc = 0;
+    TranspositionTable *tt = getTranspositionTableArgs(env, info, &argc, NULL, 0);
+    assert_or_null(tt != NULL);
+
+    chess_tt_new_search(tt);
+    return NULL;
+}
+napi_value TranspositionTableHashfull(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    size_t argc = 0;
+    TranspositionTable *tt = getTranspositionTableArgs(env, info, &argc, NULL, 0);
+    assert_or_null(tt != NULL);
+
+    napi_value res;
+    status = napi_create_int32(env, chess_tt_hashfull(tt), &res);
+    assert_or_null(status == napi_ok);
+
+    return res;
+}
+void finalize_transposition_table(napi_env env, void *finalize_data, void *finalize_hint)
+{
+    chess_tt_free((TranspositionTable *)finalize_data);
+}
+napi_value CreateTranspositionTable(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    size_t argc = 1;
+    napi_value argv[1];
+    status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+    assert_or_null(status == napi_ok);
+
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        return NULL;
+    }
+    uint32_t size_mb;
+    status = napi_get_value_uint32(env, argv[0], &size_mb);
+    assert_or_null(status == napi_ok);
+
+    TranspositionTable *tt = chess_tt_create(size_mb);
+    if (tt == NULL)
+    {
+        napi_throw_error(env, "BADCHESS", "Out of memory for the transposition table");
+        return NULL;
+    }
+
+    napi_value obj;
+    status = napi_create_object(env, &obj);
+    if (status == napi_ok)
+    {
+        napi_property_descriptor methods[] = {
+            DECLARE_NAPI_METHOD("probe", TranspositionTableProbe),
+            DECLARE_NAPI_METHOD("store", TranspositionTableStore),
+            DECLARE_NAPI_METHOD("prefetch", TranspositionTablePrefetch),
+            DECLARE_NAPI_METHOD("clear", TranspositionTableClear),
+            DECLARE_NAPI_METHOD("newSearch", TranspositionTableNewSearch),
+            DECLARE_NAPI_METHOD("hashfull", TranspositionTableHashfull),
+        };
+        status = napi_define_properties(env, obj, sizeof(methods) / sizeof(methods[0]), methods);
+    }
+    if (status == napi_ok)
+        status = napi_wrap(env, obj, tt, finalize_transposition_table, NULL, NULL);
+    if (status != napi_ok)
+    {
+        chess_tt_free(tt);
+        return NULL;
+    }
+
+    return obj;
+}
+napi_value PackMove(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    size_t argc = 1;
+    napi_value argv[1];
+    status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+    assert_or_null(status == napi_ok);
+
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        return NULL;
+    }
+    Move move;
+    assert_or_null(unwrapMove(env, argv[0], &move));
+
+    napi_value res;
+    status = napi_create_uint32(env, chess_pack_move(move), &res);
+    assert_or_null(status == napi_ok);
+
+    return res;
+}
+napi_value UnpackMove(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    size_t argc = 1;
+    napi_value argv[1];
+    status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+    assert_or_null(status == napi_ok);
+
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        return NULL;
+    }
+    uint32_t packed;
+    status = napi_get_value_uint32(env, argv[0], &packed);
+    assert_or_null(status == napi_ok);
+
+    if (packed == 0)
+    {
+        napi_value res;
+        status = napi_get_null(env, &res);
+        assert_or_null(status == napi_ok);
+        return res;
+    }
+    return wrapMove(env, chess_unpack_move(packed));
+}
+// reads a typed array of [type] into [data] and [length], throwing [error] if [val] isn't one
+bool unwrapTypedArray(napi_env env, napi_value val, napi_typedarray_type type, const char *error, void **data, size_t *length)
+{
+    napi_status status;
+
+    bool is_typedarray;
+    status = napi_is_typedarray(env, val, &is_typedarray);
+    assert_or_false(status == napi_ok);
+    napi_typedarray_type actual_type;
+    if (is_typedarray)
+    {
+        status = napi_get_typedarray_info(env, val, &actual_type, length, data, NULL, NULL);
+        assert_or_false(status == napi_ok);
+    }
+    if (!is_typedarray || actual_type != type)
+    {
+        napi_throw_type_error(env, "BADCHESS", error);
+        return false;
+    }
+    return true;
+}
+MoveOrdering *unwrapMoveOrdering(napi_env env, napi_value this)
+{
+    MoveOrdering *ordering;
+    napi_status status = napi_unwrap(env, this, (void **)&ordering);
+    if (status != napi_ok)
+        return NULL;
+    return ordering;
+}
+// reads this, a board and packed moves as the first three args of a MoveOrdering method, see MoveOrderingScoreMoves()
+MoveOrdering *getMoveOrderingArgs(napi_env env, napi_callback_info info, size_t *argc, napi_value *argv, size_t min_argc, Board **board, uint32_t **packed, size_t *len)
+{
+    napi_status status;
+
+    napi_value this_arg;
+    status = napi_get_cb_info(env, info, argc, argv, &this_arg, NULL);
+    assert_or_null(status == napi_ok);
+    if (*argc < min_argc)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected more args");
+        return NULL;
+    }
+    MoveOrdering *ordering = unwrapMoveOrdering(env, this_arg);
+    assert_or_null(ordering != NULL);
+    *board = unwrapBoard(env, argv[0]);
+    assert_or_null(*board != NULL);
+    assert_or_null(unwrapTypedArray(env, argv[1], napi_uint32_array, "Expected a Uint32Array of packed moves", (void **)packed, len));
+    if (*len > 256)
+    {
+        napi_throw_range_error(env, "BADCHESS", "Expected at most 256 moves");
+        return NULL;
+    }
+    return ordering;
+}
+napi_value MoveOrderingScoreMoves(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    size_t argc = 4;
+    napi_value argv[4];
+    Board *board;
+    uint32_t *packed;
+    size_t len;
+    MoveOrdering *ordering = getMoveOrderingArgs(env, info, &argc, argv, 4, &board, &packed, &len);
+    assert_or_null(ordering != NULL);
+    int32_t *scores;
+    size_t len_scores;
+    assert_or_null(unwrapTypedArray(env, argv[2], napi_int32_array, "Expected an Int32Array for the scores", (void **)&scores, &len_scores));
+    if (len_scores < len)
+    {
+        napi_throw_range_error(env, "BADCHESS", "Expected a score for each move");
+        return NULL;
+    }
+    int32_t ply;
+    status = napi_get_value_int32(env, argv[3], &ply);
+    assert_or_null(status == napi_ok);
+
+    Move moves[256];
+    for (size_t i = 0; i < len; i++)
+        moves[i] = chess_unpack_move(packed[i]);
+    chess_score_moves(board, moves, (int)len, scores, ordering, ply);
+
+    return NULL;
+}
+napi_value MoveOrderingOrderMoves(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    size_t argc = 3;
+    napi_value argv[3];
+    Board *board;
+    uint32_t *packed;
+    size_t len;
+    MoveOrdering *ordering = getMoveOrderingArgs(env, info, &argc, argv, 3, &board, &packed, &len);
+    assert_or_null(ordering != NULL);
+    int32_t ply;
+    status = napi_get_value_int32(env, argv[2], &ply);
+    assert_or_null(status == napi_ok);
+
+    Move moves[256];
+    int scores[256];
+    for (size_t i = 0; i < len; i++)
+        moves[i] = chess_unpack_move(packed[i]);
+    chess_score_moves(board, moves, (int)len, scores, ordering, ply);
+    for (size_t i = 0; i < len; i++)
+    {
+        chess_pick_move(moves, scores, (int)len, (int)i);
+        packed[i] = chess_pack_move(moves[i]);
+    }
+
+    return NULL;
+}
+napi_value MoveOrderingUpdate(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    napi_value this_arg;
+    size_t argc = 4;
+    napi_value argv[4];
+    status = napi_get_cb_info(env, info, &argc, argv, &this_arg, NULL);
+    assert_or_null(status == napi_ok);
+    if (argc < 4)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 4 args");
+        return NULL;
+    }
+    MoveOrdering *ordering = unwrapMoveOrdering(env, this_arg);
+    assert_or_null(ordering != NULL);
+    Board *board = unwrapBoard(env, argv[0]);
+    assert_or_null(board != NULL);
+    uint32_t packed;
+    status = napi_get_value_uint32(env, argv[1], &packed);
+    assert_or_null(status == napi_ok);
+    int32_t ply, depth;
+    status = napi_get_value_int32(env, argv[2], &ply);
+    assert_or_null(status == napi_ok);
+    status = napi_get_value_int32(env, argv[3], &depth);
+    assert_or_null(status == napi_ok);
+
+    if (packed != 0)
+        chess_ordering_update(ordering, board, chess_unpack_move(packed), ply, depth);
+
+    return NULL;
+}
+napi_value MoveOrderingClear(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    napi_value this_arg;
+    status = napi_get_cb_info(env, info, NULL, NULL, &this_arg, NULL);
+    assert_or_null(status == napi_ok);
+    MoveOrdering *ordering = unwrapMoveOrdering(env, this_arg);
+    assert_or_null(ordering != NULL);
+
+    chess_ordering_clear(ordering);
+
+    return NULL;
+}
+void finalize_move_ordering(napi_env env, void *finalize_data, void *finalize_hint)
+{
+    chess_ordering_free((MoveOrdering *)finalize_data);
+}
+napi_value CreateMoveOrdering(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    MoveOrdering *ordering = chess_ordering_create();
+    if (ordering == NULL)
+    {
+        napi_throw_error(env, "BADCHESS", "Out of memory for the move ordering");
+        return NULL;
+    }
+
+    napi_value obj;
+    status = napi_create_object(env, &obj);
+    if (status == napi_ok)
+    {
+        napi_property_descriptor methods[] = {
+            DECLARE_NAPI_METHOD("scoreMoves", MoveOrderingScoreMoves),
+            DECLARE_NAPI_METHOD("orderMoves", MoveOrderingOrderMoves),
+            DECLARE_NAPI_METHOD("update", MoveOrderingUpdate),
+            DECLARE_NAPI_METHOD("clear", MoveOrderingClear),
+        };
+        status = napi_define_properties(env, obj, sizeof(methods) / sizeof(methods[0]), methods);
+    }
+    if (status == napi_ok)
+        status = napi_wrap(env, obj, ordering, finalize_move_ordering, NULL, NULL);
+    if (status != napi_ok)
+    {
+        chess_ordering_free(ordering);
+        return NULL;
+    }
+
+    return obj;
+}
+napi_value SetSearchThreads(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    size_t argc = 1;
+    napi_value argv[1];
+    status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+    assert_or_null(status == napi_ok);
+
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        return NULL;
+    }
+    int threads;
+    status = napi_get_value_int32(env, argv[0], &threads);
+    assert_or_null(status == napi_ok);
+
+    chess_set_search_threads(threads);
+    return NULL;
+}
+// State for a search on the libuv thread pool. The board is a clone sharing the game history, which
+// is safe even if the JS board is collected meanwhile, and lets the search see repetitions.
+typedef struct
+{
+    napi_async_work work;
+    napi_deferred deferred;
+    Board *board;
+    SearchLimits limits;
+    SearchResult result;
+    napi_ref tt_ref; // keeps the table in limits from being collected during the search, or NULL
+} SearchRequest;
+
+void SearchExecute(napi_env env, void *data)
+{
+    SearchRequest *req = (SearchRequest *)data;
+    req->result = chess_search(req->board, &req->limits);
+}
+void SearchComplete(napi_env env, napi_status status, void *data)
+{
+    SearchRequest *req = (SearchRequest *)data;
+    SearchResult *result = &req->result;
+    napi_value res = NULL, move = NULL, score, depth, nodes, pv;
+    if (status == napi_ok)
+    {
+        if (result->best_move.from == 0)
+            status = napi_get_null(env, &move);
+        else if ((move = wrapMove(env, result->best_move)) == NULL)
+            status = napi_generic_failure;
+    }
+    if (status == napi_ok)
+        status = napi_create_int32(env, result->score, &score);
+    if (status == napi_ok)
+        status = napi_create_int32(env, result->depth, &depth);
+    if (status == napi_ok)
+        status = napi_create_double(env, (double)result->nodes, &nodes);
+    if (status == napi_ok)
+        status = napi_create_array_with_length(env, result->pv_len, &pv);
+    for (int i = 0; i < result->pv_len && status == napi_ok; i++)
+    {
+        napi_value pv_move = wrapMove(env, result->pv[i]);
+        status = pv_move != NULL ? napi_set_element(env, pv, i, pv_move) : napi_generic_failure;
+    }
+    if (status == napi_ok)
+        status = napi_create_object(env, &res);
+    if (status == napi_ok)
+    {
+        napi_property_descriptor properties[] = {
+            DECLARE_NAPI_PROPERTY("move", move),
+            DECLARE_NAPI_PROPERTY("score", score),
+            DECLARE_NAPI_PROPERTY("depth", depth),
+            DECLARE_NAPI_PROPERTY("nodes", nodes),
+            DECLARE_NAPI_PROPERTY("pv", pv),
+        };
+        status = napi_define_properties(env, res, sizeof(properties) / sizeof(properties[0]), properties);
+    }
+    if (status == napi_ok)
+    {
+        napi_resolve_deferred(env, req->deferred, res);
+    }
+    else
+    {
+        napi_value msg, err;
+        napi_create_string_utf8(env, "search failed", NAPI_AUTO_LENGTH, &msg);
+        napi_create_error(env, NULL, msg, &err);
+        napi_reject_deferred(env, req->deferred, err);
+    }
+    napi_delete_async_work(env, req->work);
+    if (req->tt_ref != NULL)
+        napi_delete_reference(env, req->tt_ref);
+    chess_free_board(req->board);
+    free(req);
+}
+// Reads the number property [name] of [obj] into [value] if it's set. Returns false with an exception pending if it isn't a number.
+bool getOptionalNumber(napi_env env, napi_value obj, const char *name, double *value)
+{
+    napi_status status;
+    bool has;
+    status = napi_has_named_property(env, obj, name, &has);
+    assert_or_false(status == napi_ok);
+    if (!has)
+        return true;
+    napi_value val;
+    status = napi_get_named_property(env, obj, name, &val);
+    assert_or_false(status == napi_ok);
+    napi_valuetype type;
+    status = napi_typeof(env, val, &type);
+    assert_or_false(status == napi_ok);
+    if (type == napi_undefined)
+        return true;
+    status = napi_get_value_double(env, val, value);
+    if (status == napi_number_expected)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected search limits to be numbers");
+        return false;
+    }
+    assert_or_false(status == napi_ok);
+    return true;
+}
+// Fills [limits] from a JS object like {depth, nodes, timeMs, threads, pieceValues: {pawn, knight, ...}}.
+bool unwrapSearchLimits(napi_env env, napi_value val, SearchLimits *limits)
+{
+    napi_status status;
+    double depth = 0, nodes = 0, time_ms = 0, threads = 0;
+    assert_or_false(getOptionalNumber(env, val, "depth", &depth));
+    assert_or_false(getOptionalNumber(env, val, "nodes", &nodes));
+    assert_or_false(getOptionalNumber(env, val, "timeMs", &time_ms));
+    assert_or_false(getOptionalNumber(env, val, "threads", &threads));
+    limits->depth = depth > 0 ? (int)depth : 0;
+    limits->nodes = nodes > 0 ? (uint64_t)nodes : 0;
+    limits->time_ms = time_ms > 0 ? (uint64_t)time_ms : 0;
+    limits->threads = threads > 0 ? (int)threads : 0;
+
+    bool has_values;
+    status = napi_has_named_property(env, val, "pieceValues", &has_values);
+    assert_or_false(status == napi_ok);
+    if (!has_values)
+        return true;
+    napi_value values;
+    status = napi_get_named_property(env, val, "pieceValues", &values);
+    assert_or_false(status == napi_ok);
+    napi_valuetype type;
+    status = napi_typeof(env, values, &type);
+    assert_or_false(status == napi_ok);
+    if (type != napi_object)
+        return true;
+    const char *names[] = {"pawn", "bishop", "knight", "rook", "queen"};
+    for (int piece = PAWN; piece <= QUEEN; piece++)
+    {
+        double value = 0;
+        assert_or_false(getOptionalNumber(env, values, names[piece - PAWN], &value));
+        limits->piece_values[piece] = (int)value;
+    }
+    return true;
+}
+napi_value Search(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    size_t argc = 2;
+    napi_value argv[2];
+    status = napi_get_cb_info(env, info, &argc, argv, NULL, NULL);
+    assert_or_null(status == napi_ok);
+
+    if (argc < 1)
+    {
+        napi_throw_type_error(env, "BADCHESS", "Expected at least 1 arg");
+        return NULL;
+    }
+    Board *board = unwrapBoard(env, argv[0]);
+    assert_or_null(board != NULL);
+    SearchLimits limits = {0};
+    napi_value tt_obj = NULL;
+    if (argc >= 2)
+    {
+        napi_valuetype type;
+        status = napi_typeof(env, argv[1], &type);
+        assert_or_null(status == napi_ok);
+        if (type == napi_object)
+        {
+            assert_or_null(unwrapSearchLimits(env, argv[1], &limits));
+            bool has_tt;
+            status = napi_has_named_property(env, argv[1], "tt", &has_tt);
+            assert_or_null(status == napi_ok);
+            if (has_tt)
+            {
+                status = napi_get_named_property(env, argv[1], "tt", &tt_obj);
+                assert_or_null(status == napi_ok);
+                limits.tt = unwrapTranspositionTable(env, tt_obj);
+                assert_or_null(limits.tt != NULL);
+            }
+        }
+    }
+
+    SearchRequest *req = (SearchRequest *)malloc(sizeof(SearchRequest));
+    Board *clone = req != NULL ? chess_clone_board(board) : NULL;
+    if (clone == NULL)
+    {
+        free(req);
+        napi_throw_error(env, "BADCHESS", "Out of memory for the search");
+        return NULL;
+    }
+    req->work = NULL;
+    req->deferred = NULL;
+    req->board = clone;
+    req->limits = limits;
+    req->tt_ref = NULL;
+    if (tt_obj != NULL)
+        status = napi_create_reference(env, tt_obj, 1, &req->tt_ref);
+
+    napi_value promise = NULL;
+    if (status == napi_ok)
+        status = napi_create_promise(env, &req->deferred, &promise);
+    napi_value name;
+    if (status == napi_ok)
+        status = napi_create_string_utf8(env, "chessapi:search", NAPI_AUTO_LENGTH, &name);
+    if (status == napi_ok)
+        status = napi_create_async_work(env, NULL, name, SearchExecute, SearchComplete, req, &req->work);
+    if (status == napi_ok)
+        status = napi_queue_async_work(env, req->work);
+    if (status != napi_ok)
+    {
+        napi_deferred deferred = promise != NULL ? req->deferred : NULL;
+        if (req->work != NULL)
+            napi_delete_async_work(env, req->work);
+        if (req->tt_ref != NULL)
+            napi_delete_reference(env, req->tt_ref);
+        chess_free_board(req->board);
+        free(req);
+        return failAsyncWork(env, deferred, promise, "Failed to start the search");
+    }
+
+    return promise;
+}
+napi_value GetOpponentMove(napi_env env, napi_callback_info info)
+{
+    return wrapMove(env, chess_get_opponent_move());
+}
+napi_value GetBoardPoolStats(napi_env env, napi_callback_info info)
+{
+    napi_status status;
+
+    BoardPoolStats stats;
+    chess_get_board_pool_stats(&stats);
+
+    napi_value live;
+    status = napi_create_double(env, (double)stats.live, &live);
+    assert_or_null(status == napi_ok);
+
+    napi_value peak;
+    status = napi_create_double(env, (double)stats.peak, &peak);
+    assert_or_null(status == napi_ok);
+
+    napi_value pooled;
+    status = napi_create_double(env, (double)stats.pooled, &pooled);
+    assert_or_null(status == napi_ok);
+
+    napi_value obj;
+    status = napi_create_object(env, &obj);
+    assert_or_null(status == napi_ok);
+
+    napi_property_descriptor properties[] = {
+        DECLARE_NAPI_PROPERTY("live", live),
+        DECLARE_NAPI_PROPERTY("peak", peak),
+        DECLARE_NAPI_PROPERTY("pooled", pooled),
+    };
+    status = napi_define_properties(env, obj, sizeof(properties) / sizeof(properties[0]), properties);
+    assert_or_null(status == napi_ok);
+
+    return obj;
+}
+
+napi_value Init(napi_env env, napi_value exports)
+{
+    napi_status status;
+
+    // pick the CPU backend and build the move generation tables up front rather than on the first board
+    bb_init();
 
     napi_property_descriptor properties[] = {
         DECLARE_NAPI_METHOD("getBoard", GetBoard),
@@ -765,9 +2283,28 @@ napi_value Init(napi_env env, napi_value exports)
         DECLARE_NAPI_METHOD("getTimeMillis", GetTimeMillis),
         DECLARE_NAPI_METHOD("getOpponentTimeMillis", GetOpponentTimeMillis),
         DECLARE_NAPI_METHOD("getElapsedTimeMillis", GetElapsedTimeMillis),
+        DECLARE_NAPI_METHOD("getElapsedTimeMicros", GetElapsedTimeMicros),
+        DECLARE_NAPI_METHOD("getTurnDeadlineMicros", GetTurnDeadlineMicros),
+        DECLARE_NAPI_METHOD("getMonotonicMicros", GetMonotonicMicros),
         DECLARE_NAPI_METHOD("getIndexFromBitboard", GetIndexFromBitboard),
         DECLARE_NAPI_METHOD("getBitboardFromIndex", GetBitboardFromIndex),
         DECLARE_NAPI_METHOD("getOpponentMove", GetOpponentMove),
+        DECLARE_NAPI_METHOD("popcount", Popcount),
+        DECLARE_NAPI_METHOD("getIndicesFromBitboard", GetIndicesFromBitboard),
+        DECLARE_NAPI_METHOD("getBoardPoolStats", GetBoardPoolStats),
+        DECLARE_NAPI_METHOD("initHeadless", InitHeadless),
+        DECLARE_NAPI_METHOD("getBackend", GetBackend),
+        DECLARE_NAPI_METHOD("boardFromFen", BoardFromFen),
+        DECLARE_NAPI_METHOD("zobristKeyFromFen", ZobristKeyFromFen),
+        DECLARE_NAPI_METHOD("perft", Perft),
+        DECLARE_NAPI_METHOD("perftDivide", PerftDivide),
+        DECLARE_NAPI_METHOD("setPerftThreads", SetPerftThreads),
+        DECLARE_NAPI_METHOD("search", Search),
+        DECLARE_NAPI_METHOD("setSearchThreads", SetSearchThreads),
+        DECLARE_NAPI_METHOD("createTranspositionTable", CreateTranspositionTable),
+        DECLARE_NAPI_METHOD("packMove", PackMove),
+        DECLARE_NAPI_METHOD("unpackMove", UnpackMove),
+        DECLARE_NAPI_METHOD("createMoveOrdering", CreateMoveOrdering),
     };
     status = napi_define_properties(env, exports, sizeof(properties) / sizeof(properties[0]), properties);
     assert_or_null(status == napi_ok);